@@ -0,0 +1,146 @@
+#include "application_digest.hpp"
+#include "uc_error_codes.hpp"
+
+#include <algorithm>
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "ApplicationDigest"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+ApplicationDigest::ApplicationDigest(uint32_t headerSize) :
+    _headerSize(headerSize)
+{
+    mbedtls_sha256_init(&_shaContext);
+    reset();
+}
+
+ApplicationDigest::~ApplicationDigest()
+{
+    mbedtls_sha256_free(&_shaContext);
+}
+
+void ApplicationDigest::reset()
+{
+    mbedtls_sha256_starts(&_shaContext, 0);
+    memset(_headerBuffer, 0, sizeof(_headerBuffer));
+    memset(_hash, 0, sizeof(_hash));
+    _nbrOfBytes = 0;
+    _firmwareSize = 0;
+    _headerResult = UC_ERR_INVALID_HEADER;
+    _complete = false;
+}
+
+void ApplicationDigest::update(const uint8_t *pData, uint32_t size)
+{
+    while (size > 0) {
+        uint32_t chunkSize = size;
+        if (_nbrOfBytes < MbedApplication::kHeaderSizeV2) {
+            // keep a copy of the header for getting the firmware size
+            chunkSize = std::min(size, (uint32_t)(MbedApplication::kHeaderSizeV2 - _nbrOfBytes));
+            memcpy(&_headerBuffer[_nbrOfBytes], pData, chunkSize);
+            if (_nbrOfBytes + chunkSize == MbedApplication::kHeaderSizeV2) {
+                _headerResult = MbedApplication::parseFirmwareSize(_headerBuffer, _firmwareSize);
+                if (_headerResult != UC_ERR_NONE) {
+                    tr_error(" Invalid application header: %" PRIi32 "", _headerResult);
+                }
+            }
+        } else if (_nbrOfBytes < _headerSize) {
+            // skip the padding between the header and the application
+            chunkSize = std::min(size, (uint32_t)(_headerSize - _nbrOfBytes));
+        } else if (_headerResult == UC_ERR_NONE && _nbrOfBytes < _headerSize + _firmwareSize) {
+            // hash the application, the bytes beyond the firmware size are padding
+            chunkSize = std::min(size, (uint32_t)(_headerSize + _firmwareSize - _nbrOfBytes));
+            mbedtls_sha256_update(&_shaContext, pData, chunkSize);
+        }
+
+        pData += chunkSize;
+        size -= chunkSize;
+        _nbrOfBytes += chunkSize;
+    }
+}
+
+int32_t ApplicationDigest::updateFromFlash(FlashUpdater &flashUpdater, uint32_t address, uint32_t size)
+{
+    const uint8_t *pData = flashUpdater.getFlashSpan(address, size);
+    if (pData != NULL || size == 0) {
+        update(pData, size);
+        return UC_ERR_NONE;
+    }
+
+    uint8_t buffer[kReadBufferSize];
+    for (uint32_t offset = 0; offset < size; offset += kReadBufferSize) {
+        const uint32_t readSize = (size - offset < kReadBufferSize) ? (size - offset) : kReadBufferSize;
+        int err = flashUpdater.read(buffer, address + offset, readSize);
+        if (err != 0) {
+            tr_error("Flash read failed: %d", err);
+            return UC_ERR_READING_FLASH;
+        }
+        update(buffer, readSize);
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t ApplicationDigest::finish()
+{
+    mbedtls_sha256_finish(&_shaContext, _hash);
+
+    int32_t result = _headerResult;
+    if (result == UC_ERR_NONE) {
+        if (_firmwareSize == 0) {
+            result = UC_ERR_FIRMWARE_EMPTY;
+        } else if (_nbrOfBytes < _headerSize + _firmwareSize) {
+            tr_error(" Received %" PRIu64 " bytes out of %" PRIu64 "", _nbrOfBytes, _headerSize + _firmwareSize);
+            result = UC_ERR_FIRMWARE_INCOMPLETE;
+        }
+    }
+    _complete = (result == UC_ERR_NONE);
+
+    return result;
+}
+
+uint64_t ApplicationDigest::getImageSize() const
+{
+    return (_headerResult == UC_ERR_NONE) ? _headerSize + _firmwareSize : 0;
+}
+
+bool ApplicationDigest::isComplete() const
+{
+    return _complete;
+}
+
+uint64_t ApplicationDigest::getFirmwareSize() const
+{
+    return _firmwareSize;
+}
+
+const uint8_t *ApplicationDigest::getHash() const
+{
+    return _hash;
+}
+
+int32_t ApplicationDigest::checkHeader() const
+{
+    MbedApplication::HeaderFields headerFields;
+    int32_t result = MbedApplication::parseHeader(_headerBuffer, headerFields);
+    if (result != UC_ERR_NONE) {
+        return result;
+    }
+
+    if (headerFields.firmwareSize == 0) {
+        return UC_ERR_FIRMWARE_EMPTY;
+    }
+    if (! _complete || headerFields.firmwareSize != _firmwareSize) {
+        return UC_ERR_FIRMWARE_INCOMPLETE;
+    }
+    if (memcmp(headerFields.hash, _hash, kHashSize) != 0) {
+        return UC_ERR_HASH_INVALID;
+    }
+
+    return UC_ERR_NONE;
+}
+
+} // namespace update_client
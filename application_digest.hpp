@@ -0,0 +1,53 @@
+#pragma once
+
+#include "mbed_application.hpp"
+
+#include "mbedtls/sha256.h"
+
+namespace update_client {
+
+// ApplicationDigest computes the SHA-256 of an application while the image (header included)
+// is being written to flash, so that the application can be validated without reading it back
+
+class ApplicationDigest {
+public:
+    // constructor
+    explicit ApplicationDigest(uint32_t headerSize);
+    ~ApplicationDigest();
+
+    // restart the digest for a new image
+    void reset();
+    // feed the next bytes of the image, in the order in which they are programmed
+    void update(const uint8_t *pData, uint32_t size);
+    // feed the next bytes of the image from flash, where they are already programmed
+    int32_t updateFromFlash(FlashUpdater &flashUpdater, uint32_t address, uint32_t size);
+    // finalize the digest, returns UC_ERR_NONE if the whole firmware has been hashed
+    int32_t finish();
+    // size of the image (header included) announced by its header, 0 until the header is fed
+    uint64_t getImageSize() const;
+
+    // accessors valid after a successful call to finish()
+    bool isComplete() const;
+    uint64_t getFirmwareSize() const;
+    const uint8_t *getHash() const;
+    // check the digest against the header that was fed with the image, so that an image
+    // can be validated before its header is programmed
+    int32_t checkHeader() const;
+
+    static constexpr uint32_t kHashSize = (256 / 8);
+
+private:
+    static constexpr uint32_t kReadBufferSize = 256;
+
+    // data members
+    mbedtls_sha256_context _shaContext;
+    const uint32_t _headerSize;
+    uint8_t _headerBuffer[MbedApplication::kHeaderSizeV2];
+    uint64_t _nbrOfBytes;
+    uint64_t _firmwareSize;
+    int32_t _headerResult;
+    bool _complete;
+    uint8_t _hash[kHashSize];
+};
+
+} // namespace update_client
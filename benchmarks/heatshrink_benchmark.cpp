@@ -0,0 +1,226 @@
+// Host benchmark of HeatshrinkDecoder
+// The image given on the command line (any binary, a synthetic image otherwise) is compressed
+// with a reference encoder for each window and lookahead configuration, then decoded once with
+// input and output split at random sizes, which must reproduce the image, and several times
+// with 1 KiB chunks, as in the receive path, for measuring the decoding speed. The compression
+// ratio, the speed and the RAM used by the decoder are reported
+// Build on the host with heatshrink_decoder.cpp and uc_arena.cpp (or an arena backed by malloc)
+
+#include "heatshrink_decoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace update_client;
+
+namespace {
+
+struct Configuration {
+    uint8_t windowBits;
+    uint8_t lookaheadBits;
+};
+
+constexpr Configuration kConfigurations[] = { { 8, 4 }, { 10, 5 } };
+constexpr uint32_t kSyntheticImageSize = 200000;
+constexpr uint32_t kChunkSize = 1024;
+constexpr uint32_t kNbrOfRepetitions = 20;
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t> &output) :
+        _output(output),
+        _currentByte(0),
+        _nbrOfBits(0)
+    {
+    }
+
+    void write(uint32_t value, uint8_t count)
+    {
+        while (count > 0) {
+            count--;
+            _currentByte = (uint8_t)((_currentByte << 1) | ((value >> count) & 1));
+            if (++_nbrOfBits == 8) {
+                _output.push_back(_currentByte);
+                _currentByte = 0;
+                _nbrOfBits = 0;
+            }
+        }
+    }
+
+    // the last byte is padded with zero bits
+    void flush()
+    {
+        if (_nbrOfBits > 0) {
+            write(0, 8 - _nbrOfBits);
+        }
+    }
+
+private:
+    std::vector<uint8_t> &_output;
+    uint8_t _currentByte;
+    uint8_t _nbrOfBits;
+};
+
+// greedy LZSS encoder producing the heatshrink format: a tag bit set for a literal followed by
+// the byte, or cleared for a back reference followed by offset - 1 on windowBits bits and
+// count - 1 on lookaheadBits bits
+std::vector<uint8_t> encode(const std::vector<uint8_t> &input, const Configuration &configuration)
+{
+    const uint32_t windowSize = 1UL << configuration.windowBits;
+    const uint32_t lookaheadSize = 1UL << configuration.lookaheadBits;
+    // positions of the previous occurrence of each pair of bytes, for finding matches quickly
+    std::vector<int32_t> lastPosition(65536, -1);
+    std::vector<int32_t> previousPosition(input.size(), -1);
+
+    std::vector<uint8_t> output;
+    BitWriter bitWriter(output);
+    uint32_t index = 0;
+    while (index < input.size()) {
+        uint32_t bestCount = 0;
+        uint32_t bestOffset = 0;
+        if (index + 1 < input.size()) {
+            int32_t position = lastPosition[(input[index] << 8) | input[index + 1]];
+            while (position >= 0 && index - (uint32_t) position <= windowSize) {
+                uint32_t count = 0;
+                while (count < lookaheadSize && index + count < input.size() &&
+                        input[position + count] == input[index + count]) {
+                    count++;
+                }
+                if (count > bestCount) {
+                    bestCount = count;
+                    bestOffset = index - (uint32_t) position;
+                }
+                if (count == lookaheadSize) {
+                    break;
+                }
+                position = previousPosition[position];
+            }
+        }
+
+        uint32_t step = 1;
+        if (bestCount >= 2) {
+            bitWriter.write(0, 1);
+            bitWriter.write(bestOffset - 1, configuration.windowBits);
+            bitWriter.write(bestCount - 1, configuration.lookaheadBits);
+            step = bestCount;
+        } else {
+            bitWriter.write(1, 1);
+            bitWriter.write(input[index], 8);
+        }
+        for (uint32_t stepIndex = 0; stepIndex < step; stepIndex++, index++) {
+            if (index + 1 < input.size()) {
+                const uint32_t key = (input[index] << 8) | input[index + 1];
+                previousPosition[index] = lastPosition[key];
+                lastPosition[key] = (int32_t) index;
+            }
+        }
+    }
+    bitWriter.flush();
+
+    return output;
+}
+
+// decode the whole input, feeding at most inputChunkSize bytes and accepting at most
+// outputChunkSize bytes per call (random sizes up to these if randomSplit is set)
+uint32_t decode(HeatshrinkDecoder &decoder, const std::vector<uint8_t> &input, std::vector<uint8_t> &output,
+                uint32_t inputChunkSize, uint32_t outputChunkSize, bool randomSplit)
+{
+    decoder.reset();
+    uint32_t inputIndex = 0;
+    uint32_t outputIndex = 0;
+    while ((inputIndex < input.size() || ! decoder.needsInput()) && outputIndex < output.size()) {
+        uint32_t inputSize = std::min<uint32_t>(input.size() - inputIndex, inputChunkSize);
+        uint32_t outputSize = std::min<uint32_t>(output.size() - outputIndex, outputChunkSize);
+        if (randomSplit) {
+            inputSize = std::min<uint32_t>(inputSize, 1 + rand() % inputChunkSize);
+            outputSize = std::min<uint32_t>(outputSize, 1 + rand() % outputChunkSize);
+        }
+        uint32_t nbrOfBytesConsumed = 0;
+        uint32_t nbrOfBytesProduced = 0;
+        decoder.decode(&input[inputIndex], inputSize, nbrOfBytesConsumed,
+                       &output[outputIndex], outputSize, nbrOfBytesProduced);
+        inputIndex += nbrOfBytesConsumed;
+        outputIndex += nbrOfBytesProduced;
+    }
+
+    return outputIndex;
+}
+
+bool loadImage(const char *pPath, std::vector<uint8_t> &image)
+{
+    FILE *pFile = fopen(pPath, "rb");
+    if (pFile == NULL) {
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t size = 0;
+    while ((size = fread(buffer, 1, sizeof(buffer), pFile)) > 0) {
+        image.insert(image.end(), buffer, buffer + size);
+    }
+    fclose(pFile);
+
+    return ! image.empty();
+}
+
+// repeated instruction patterns with varying operands, roughly as compressible as code
+std::vector<uint8_t> buildSyntheticImage(uint32_t size)
+{
+    std::vector<uint8_t> image(size);
+    uint32_t seed = 0x12345678;
+    for (uint32_t index = 0; index < size; index++) {
+        seed = seed * 1103515245 + 12345;
+        image[index] = ((index % 16) < 10) ? (uint8_t)((index % 16) * 17) : (uint8_t)(seed >> 28);
+    }
+
+    return image;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<uint8_t> image;
+    if (argc > 1) {
+        if (! loadImage(argv[1], image)) {
+            printf("Cannot read image %s\n", argv[1]);
+            return 1;
+        }
+    } else {
+        image = buildSyntheticImage(kSyntheticImageSize);
+    }
+    printf("Image of %u bytes\n", (unsigned) image.size());
+
+    int exitCode = 0;
+    for (const Configuration &configuration : kConfigurations) {
+        const std::vector<uint8_t> compressedImage = encode(image, configuration);
+        HeatshrinkDecoder decoder(configuration.windowBits, configuration.lookaheadBits);
+        std::vector<uint8_t> decodedImage(image.size());
+
+        // any split of input and output must give the same result
+        srand(1);
+        const uint32_t nbrOfBytesDecoded = decode(decoder, compressedImage, decodedImage, 300, 700, true);
+        const bool isIdentical = (nbrOfBytesDecoded == image.size() &&
+                                  memcmp(decodedImage.data(), image.data(), image.size()) == 0);
+        if (! isIdentical) {
+            exitCode = 1;
+        }
+
+        const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+        for (uint32_t repetition = 0; repetition < kNbrOfRepetitions; repetition++) {
+            decode(decoder, compressedImage, decodedImage, kChunkSize, kChunkSize, false);
+        }
+        const double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        printf("-w %u -l %u: %s, ratio %.1f%%, decode %.1f MB/s, RAM window %u + state %u bytes\n",
+               configuration.windowBits, configuration.lookaheadBits, isIdentical ? "OK" : "MISMATCH",
+               100.0 * compressedImage.size() / image.size(),
+               kNbrOfRepetitions * image.size() / duration / 1e6,
+               (unsigned) decoder.getWindowSize(), (unsigned) sizeof(decoder));
+    }
+
+    return exitCode;
+}
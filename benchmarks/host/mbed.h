@@ -0,0 +1,434 @@
+#pragma once
+
+// Minimal replacement of mbed.h for building the update client on the host
+// Only what the update client uses is provided: Thread, EventFlags, Mutex and Queue run on
+// std::thread, CriticalSectionLock is a global lock and errors abort. The configuration is
+// the one mbed would generate in mbed_config.h, each value can be overridden with -D
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// target and bootloader configuration, the simulated flash must cover these areas
+#ifndef MBED_ROM_START
+#define MBED_ROM_START 0x08000000
+#endif
+#ifndef MBED_ROM_SIZE
+#define MBED_ROM_SIZE 0x200000
+#endif
+#ifndef HEADER_ADDR
+#define HEADER_ADDR 0x08010000
+#endif
+#ifndef APPLICATION_ADDR
+#define APPLICATION_ADDR 0x08011000
+#endif
+#ifndef OS_STACK_SIZE
+#define OS_STACK_SIZE 4096
+#endif
+
+// update-client configuration (see mbed_lib.json), with a storage and a metadata area
+#ifndef MBED_CONF_UPDATE_CLIENT_STORAGE_ADDRESS
+#define MBED_CONF_UPDATE_CLIENT_STORAGE_ADDRESS 0x08100000
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_STORAGE_SIZE
+#define MBED_CONF_UPDATE_CLIENT_STORAGE_SIZE 0xE0000
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS
+#define MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS 1
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_UNIFORM_SECTOR_SIZE
+#define MBED_CONF_UPDATE_CLIENT_UNIFORM_SECTOR_SIZE 0
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_PAGE_SIZE
+#define MBED_CONF_UPDATE_CLIENT_PAGE_SIZE 0
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_MEMORY_MAPPED_FLASH
+#define MBED_CONF_UPDATE_CLIENT_MEMORY_MAPPED_FLASH 1
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_PROGRAM_VERIFY_MODE
+#define MBED_CONF_UPDATE_CLIENT_PROGRAM_VERIFY_MODE 0
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_VERIFY_SAMPLE_INTERVAL
+#define MBED_CONF_UPDATE_CLIENT_VERIFY_SAMPLE_INTERVAL 8
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_PRE_ERASE_CANDIDATE_SLOT
+#define MBED_CONF_UPDATE_CLIENT_PRE_ERASE_CANDIDATE_SLOT 0
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_TRANSFER_TIMEOUT
+#define MBED_CONF_UPDATE_CLIENT_TRANSFER_TIMEOUT 2000
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_FRAMED_PROTOCOL
+#define MBED_CONF_UPDATE_CLIENT_FRAMED_PROTOCOL 0
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_FRAME_PAYLOAD_SIZE
+#define MBED_CONF_UPDATE_CLIENT_FRAME_PAYLOAD_SIZE 1024
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_FRAME_WINDOW_SIZE
+#define MBED_CONF_UPDATE_CLIENT_FRAME_WINDOW_SIZE 8
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_COMPRESSED_STREAM
+#define MBED_CONF_UPDATE_CLIENT_COMPRESSED_STREAM 0
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_DELTA_STREAM
+#define MBED_CONF_UPDATE_CLIENT_DELTA_STREAM 0
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_DECOMPRESSION_WINDOW_BITS
+#define MBED_CONF_UPDATE_CLIENT_DECOMPRESSION_WINDOW_BITS 8
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_DECOMPRESSION_LOOKAHEAD_BITS
+#define MBED_CONF_UPDATE_CLIENT_DECOMPRESSION_LOOKAHEAD_BITS 4
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_DIRECT_TO_ACTIVE
+#define MBED_CONF_UPDATE_CLIENT_DIRECT_TO_ACTIVE 0
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_POSITION_INDEPENDENT_IMAGES
+#define MBED_CONF_UPDATE_CLIENT_POSITION_INDEPENDENT_IMAGES 0
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_PIPELINE_BUFFER_SIZE
+#define MBED_CONF_UPDATE_CLIENT_PIPELINE_BUFFER_SIZE 1024
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_PIPELINE_BUFFER_COUNT
+#define MBED_CONF_UPDATE_CLIENT_PIPELINE_BUFFER_COUNT 2
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_ARENA_SIZE
+#define MBED_CONF_UPDATE_CLIENT_ARENA_SIZE 0
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_METADATA_ADDRESS
+#define MBED_CONF_UPDATE_CLIENT_METADATA_ADDRESS 0x081E0000
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_METADATA_SIZE
+#define MBED_CONF_UPDATE_CLIENT_METADATA_SIZE 0x20000
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_SCRUBBER_CHUNK_SIZE
+#define MBED_CONF_UPDATE_CLIENT_SCRUBBER_CHUNK_SIZE 4096
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_SCRUBBER_CPU_BUDGET
+#define MBED_CONF_UPDATE_CLIENT_SCRUBBER_CPU_BUDGET 5
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_SCRUBBER_PERIOD
+#define MBED_CONF_UPDATE_CLIENT_SCRUBBER_PERIOD 3600
+#endif
+
+// toolchain and platform macros
+#define MBED_WEAK __attribute__((weak))
+#define MBED_ALIGN(N) alignas(N)
+#define MBED_PACKED(UNUSED) UNUSED __attribute__((packed))
+#define MBED_ASSERT(expr) assert(expr)
+
+#define MBED_MODULE_APPLICATION 0
+#define MBED_ERROR_CODE_OUT_OF_MEMORY 1
+#define MBED_MAKE_ERROR(module, code) (((module) << 16) | (code))
+#define MBED_ERROR1(error, message, value)                                                      \
+    do {                                                                                        \
+        fprintf(stderr, "Fatal error 0x%x: %s (%u)\n", (unsigned)(error), (message), (unsigned)(value)); \
+        abort();                                                                                \
+    } while (0)
+
+inline uint32_t core_util_atomic_load_u32(const volatile uint32_t *pValue)
+{
+    return __atomic_load_n(pValue, __ATOMIC_SEQ_CST);
+}
+
+inline int32_t core_util_atomic_load_s32(const volatile int32_t *pValue)
+{
+    return __atomic_load_n(pValue, __ATOMIC_SEQ_CST);
+}
+
+inline void core_util_atomic_store_u32(volatile uint32_t *pValue, uint32_t value)
+{
+    __atomic_store_n(pValue, value, __ATOMIC_SEQ_CST);
+}
+
+inline uint32_t core_util_atomic_incr_u32(volatile uint32_t *pValue, uint32_t delta)
+{
+    return __atomic_add_fetch(pValue, delta, __ATOMIC_SEQ_CST);
+}
+
+typedef enum {
+    osPriorityIdle = 1,
+    osPriorityLow = 8,
+    osPriorityBelowNormal = 16,
+    osPriorityNormal = 24,
+    osPriorityAboveNormal = 32,
+    osPriorityHigh = 40
+} osPriority_t;
+
+typedef int32_t osStatus;
+static constexpr osStatus osOK = 0;
+static constexpr osStatus osError = -1;
+static constexpr uint32_t osFlagsError = 0x80000000U;
+static constexpr uint32_t osWaitForever = 0xFFFFFFFFU;
+
+namespace mbed {
+
+template<typename F>
+class Callback;
+
+template<typename R, typename... Args>
+class Callback<R(Args...)> {
+public:
+    Callback() {}
+
+    template<typename T>
+    Callback(T *pObject, R(T::*pMethod)(Args...)) :
+        _function([pObject, pMethod](Args... args) {
+        return (pObject->*pMethod)(args...);
+    })
+    {
+    }
+
+    R operator()(Args... args) const
+    {
+        return _function(args...);
+    }
+
+private:
+    std::function<R(Args...)> _function;
+};
+
+template<typename T, typename R, typename... Args>
+Callback<R(Args...)> callback(T *pObject, R(T::*pMethod)(Args...))
+{
+    return Callback<R(Args...)>(pObject, pMethod);
+}
+
+// interrupts do not exist on the host, a global lock serializes the critical sections
+class CriticalSectionLock {
+public:
+    CriticalSectionLock()
+    {
+        getMutex().lock();
+    }
+
+    ~CriticalSectionLock()
+    {
+        getMutex().unlock();
+    }
+
+private:
+    static std::recursive_mutex &getMutex()
+    {
+        static std::recursive_mutex mutex;
+        return mutex;
+    }
+};
+
+} // namespace mbed
+
+namespace rtos {
+
+namespace Kernel {
+
+struct Clock {
+    typedef std::chrono::milliseconds duration;
+};
+
+constexpr std::chrono::milliseconds wait_for_u32_forever(osWaitForever);
+
+inline uint64_t get_ms_count()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace Kernel
+
+// priorities, stack sizes and stacks are ignored, a thread runs once as on mbed
+class Thread {
+public:
+    Thread(osPriority_t priority = osPriorityNormal, uint32_t stackSize = OS_STACK_SIZE,
+           unsigned char *pStackMemory = nullptr, const char *pName = nullptr)
+    {
+        (void) priority;
+        (void) stackSize;
+        (void) pStackMemory;
+        (void) pName;
+    }
+
+    ~Thread()
+    {
+        join();
+    }
+
+    osStatus start(mbed::Callback<void()> task)
+    {
+        if (_thread.joinable()) {
+            return osError;
+        }
+        _thread = std::thread(task);
+        return osOK;
+    }
+
+    osStatus join()
+    {
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+        return osOK;
+    }
+
+private:
+    std::thread _thread;
+};
+
+class Mutex {
+public:
+    void lock()
+    {
+        _mutex.lock();
+    }
+
+    bool trylock()
+    {
+        return _mutex.try_lock();
+    }
+
+    void unlock()
+    {
+        _mutex.unlock();
+    }
+
+private:
+    std::recursive_mutex _mutex;
+};
+
+class EventFlags {
+public:
+    EventFlags() :
+        _flags(0)
+    {
+    }
+
+    uint32_t set(uint32_t flags)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _flags |= flags;
+        _condition.notify_all();
+        return _flags;
+    }
+
+    uint32_t clear(uint32_t flags = 0x7fffffff)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const uint32_t previousFlags = _flags;
+        _flags &= ~flags;
+        return previousFlags;
+    }
+
+    uint32_t get() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _flags;
+    }
+
+    // returns the flags that were set, osFlagsError with the timeout bit set on timeout
+    uint32_t wait_any(uint32_t flags, uint32_t timeoutMs = osWaitForever, bool clear = true)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        const auto isSet = [this, flags]() {
+            return (_flags & flags) != 0;
+        };
+        if (timeoutMs == osWaitForever) {
+            _condition.wait(lock, isSet);
+        } else if (! _condition.wait_for(lock, std::chrono::milliseconds(timeoutMs), isSet)) {
+            return osFlagsError | 0x2;
+        }
+        const uint32_t currentFlags = _flags;
+        if (clear) {
+            _flags &= ~flags;
+        }
+        return currentFlags;
+    }
+
+private:
+    mutable std::mutex _mutex;
+    std::condition_variable _condition;
+    uint32_t _flags;
+};
+
+// a queue of at most N pointers
+template<typename T, uint32_t N>
+class Queue {
+public:
+    bool empty() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _items.empty();
+    }
+
+    bool full() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _items.size() >= N;
+    }
+
+    bool try_put(T *pItem)
+    {
+        return try_put_for(Kernel::Clock::duration(0), pItem);
+    }
+
+    bool try_put_for(Kernel::Clock::duration timeout, T *pItem)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        const auto hasRoom = [this]() {
+            return _items.size() < N;
+        };
+        if (! wait(lock, timeout, hasRoom)) {
+            return false;
+        }
+        _items.push_back(pItem);
+        _condition.notify_all();
+        return true;
+    }
+
+    bool try_get(T **ppItem)
+    {
+        return try_get_for(Kernel::Clock::duration(0), ppItem);
+    }
+
+    bool try_get_for(Kernel::Clock::duration timeout, T **ppItem)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        const auto hasItem = [this]() {
+            return ! _items.empty();
+        };
+        if (! wait(lock, timeout, hasItem)) {
+            return false;
+        }
+        *ppItem = _items.front();
+        _items.pop_front();
+        _condition.notify_all();
+        return true;
+    }
+
+private:
+    template<typename Predicate>
+    bool wait(std::unique_lock<std::mutex> &lock, Kernel::Clock::duration timeout, Predicate predicate)
+    {
+        if (timeout == Kernel::wait_for_u32_forever) {
+            _condition.wait(lock, predicate);
+            return true;
+        }
+        return _condition.wait_for(lock, timeout, predicate);
+    }
+
+    mutable std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<T *> _items;
+};
+
+} // namespace rtos
+
+using namespace mbed;
+using namespace rtos;
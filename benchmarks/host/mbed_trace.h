@@ -0,0 +1,10 @@
+#pragma once
+
+// traces are disabled on the host, so that they do not disturb the measurements
+
+#define MBED_CONF_MBED_TRACE_ENABLE 0
+
+#define tr_debug(...) ((void) 0)
+#define tr_info(...) ((void) 0)
+#define tr_warn(...) ((void) 0)
+#define tr_error(...) ((void) 0)
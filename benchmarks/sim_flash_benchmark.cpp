@@ -0,0 +1,287 @@
+// Host benchmark of the flash access paths of the update client on the simulated flash
+// It measures readPage, writePage, alignAddressToSector, installApplication and
+// checkApplication for several image sizes and numbers of slots, on a uniform and on a non
+// uniform sector map, with destinations that are blank or hold data (which must be erased
+// first). It reports the wall time on the host with the operations counted by SimFlashDevice
+// and the time they would take on the modeled device
+// Build on the host with USE_SIMULATED_FLASH_UC=1 and a bootloader configuration (for
+// POST_APPLICATION_ADDR), together with the update client sources and mbedtls. Slot counts
+// above update-client.storage-locations are skipped: build with
+// -DMBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS=4 so that 1, 2 and 4 slots are measured
+
+#include "candidate_applications.hpp"
+#include "flash_updater.hpp"
+#include "mbed_application.hpp"
+#include "sim_flash_iap.hpp"
+#include "uc_arena.hpp"
+#include "uc_crc32.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbedtls/sha256.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace update_client;
+
+namespace {
+
+// modeled devices of 4 MiB with 256 bytes pages, the active application is in the first half
+// and the slots in the second half
+constexpr uint32_t kFlashSize = 4 * 1024 * 1024;
+constexpr uint32_t kPageSize = 256;
+
+struct Layout {
+    const char *pName;
+    SimFlashDevice::SectorRegion sectorRegions[3];
+    uint32_t nbrOfSectorRegions;
+    SimFlashDevice::CostModel costModel;
+};
+
+const Layout kLayouts[] = {
+    // uniform 4 KiB sectors, as on many small devices
+    { "uniform", { { 4096, kFlashSize / 4096 } }, 1, { 25000, 0, 400, 20000 } },
+    // 4 x 16 KiB, 1 x 64 KiB and 128 KiB sectors, as on STM32F4, where the erase time grows
+    // with the sector size
+    {
+        "non-uniform",
+        { { 16 * 1024, 4 }, { 64 * 1024, 1 }, { 128 * 1024, (kFlashSize - 128 * 1024) / (128 * 1024) } },
+        3, { 0, 8000, 400, 20000 }
+    }
+};
+
+constexpr uint32_t kImageSizes[] = { 16 * 1024, 64 * 1024, 256 * 1024 };
+constexpr uint32_t kNbrOfSlots[] = { 1, 2, 4 };
+
+// V2 header layout, see MbedApplication
+constexpr uint32_t kHeaderMagicV2 = 0x5a51b3d4UL;
+constexpr uint32_t kHeaderVersionV2 = 2;
+constexpr uint32_t kFirmwareVersionOffset = 8;
+constexpr uint32_t kFirmwareSizeOffset = 16;
+constexpr uint32_t kHashOffset = 24;
+constexpr uint32_t kHeaderCrcOffset = 108;
+
+// parameters of a run, printed with each measurement
+struct RunParameters {
+    const char *pLayoutName;
+    bool isBlank;
+    uint32_t imageSize;
+    uint32_t nbrOfSlots;
+};
+
+class Measurement {
+public:
+    Measurement(const char *pName, const RunParameters &parameters) :
+        _pName(pName),
+        _parameters(parameters),
+        _startTime(std::chrono::steady_clock::now())
+    {
+        SimFlashDevice::getDefault().resetStats();
+    }
+
+    void report(int32_t result) const
+    {
+        const double wallTimeUs = std::chrono::duration<double, std::micro>(
+                                      std::chrono::steady_clock::now() - _startTime).count();
+        const SimFlashDevice::Stats &stats = SimFlashDevice::getDefault().getStats();
+        printf("%-22s %-11s %-6s %7" PRIu32 " %5" PRIu32 " %10.1f %12.1f %7" PRIu32 " %7" PRIu32 " %6" PRIu32 " %6" PRIi32 "\n",
+               _pName, _parameters.pLayoutName, _parameters.isBlank ? "blank" : "data",
+               _parameters.imageSize, _parameters.nbrOfSlots, wallTimeUs, stats.modeledTimeNs / 1000.0,
+               stats.nbrOfReads, stats.nbrOfPrograms, stats.nbrOfErases, result);
+    }
+
+private:
+    const char *_pName;
+    const RunParameters &_parameters;
+    std::chrono::steady_clock::time_point _startTime;
+};
+
+void writeUint32(uint8_t *pBuffer, uint32_t value)
+{
+    pBuffer[0] = (uint8_t)(value >> 24);
+    pBuffer[1] = (uint8_t)(value >> 16);
+    pBuffer[2] = (uint8_t)(value >> 8);
+    pBuffer[3] = (uint8_t) value;
+}
+
+// an image with a valid header, followed by firmware that compresses like code
+std::vector<uint8_t> buildImage(uint32_t headerSize, uint32_t firmwareSize)
+{
+    std::vector<uint8_t> image(headerSize + firmwareSize, 0xFF);
+    uint8_t *pFirmware = &image[headerSize];
+    uint32_t seed = 0x12345678;
+    for (uint32_t index = 0; index < firmwareSize; index++) {
+        seed = seed * 1103515245 + 12345;
+        pFirmware[index] = ((index % 64) < 48) ? (uint8_t)(index / 4) : (uint8_t)(seed >> 24);
+    }
+
+    uint8_t *pHeader = image.data();
+    memset(pHeader, 0, MbedApplication::kHeaderSizeV2);
+    writeUint32(&pHeader[0], kHeaderMagicV2);
+    writeUint32(&pHeader[4], kHeaderVersionV2);
+    writeUint32(&pHeader[kFirmwareVersionOffset + 4], 1);
+    writeUint32(&pHeader[kFirmwareSizeOffset + 4], firmwareSize);
+    mbedtls_sha256_context shaContext;
+    mbedtls_sha256_init(&shaContext);
+    mbedtls_sha256_starts(&shaContext, 0);
+    mbedtls_sha256_update(&shaContext, pFirmware, firmwareSize);
+    mbedtls_sha256_finish(&shaContext, &pHeader[kHashOffset]);
+    mbedtls_sha256_free(&shaContext);
+    writeUint32(&pHeader[kHeaderCrcOffset], crc32(pHeader, kHeaderCrcOffset));
+
+    return image;
+}
+
+void runBenchmark(FlashUpdater &flashUpdater, uint32_t storageAddress, uint32_t storageSize,
+                  const RunParameters &parameters)
+{
+    // buffers allocated from the arena are released at the end of each run, as for an update session
+    UpdateClientArena::Session arenaSession;
+    const uint32_t headerSize = APPLICATION_ADDR - HEADER_ADDR;
+    const uint32_t imageSize = parameters.imageSize;
+    std::vector<uint8_t> image = buildImage(headerSize, imageSize - headerSize);
+    std::vector<char> pageBuffer(kPageSize);
+    std::vector<char> readPageBuffer(kPageSize);
+
+    // the slot and the active application are either blank or hold data, which is set up
+    // without accounting for it
+    SimFlashDevice &device = SimFlashDevice::getDefault();
+    memset(device.getMemory(), parameters.isBlank ? device.get_erase_value() : 0x00, device.get_flash_size());
+
+    // the last slot is used, its address is the one computed by the candidate applications
+    const uint32_t slotIndex = parameters.nbrOfSlots - 1;
+    uint32_t slotAddress = 0;
+    uint32_t slotSize = 0;
+    {
+        CandidateApplications candidateApplications(flashUpdater, storageAddress, storageSize, headerSize,
+                                                    parameters.nbrOfSlots);
+        if (candidateApplications.getCandidateAddress(slotIndex, slotAddress, slotSize) != UC_ERR_NONE ||
+                slotSize < imageSize) {
+            printf("%-22s %-11s %-6s %7" PRIu32 " %5" PRIu32 " skipped, the image does not fit in the slot\n",
+                   "-", parameters.pLayoutName, parameters.isBlank ? "blank" : "data", imageSize, parameters.nbrOfSlots);
+            return;
+        }
+    }
+
+    // write the image into the slot, page by page
+    {
+        Measurement measurement("writePage", parameters);
+        uint32_t address = slotAddress;
+        uint32_t nextSectorAddress = flashUpdater.getNextSectorAddress(address);
+        bool sectorErased = false;
+        size_t pagesFlashed = 0;
+        int32_t result = UC_ERR_NONE;
+        for (uint32_t offset = 0; offset < imageSize && result == UC_ERR_NONE; offset += kPageSize) {
+            const uint32_t size = (imageSize - offset < kPageSize) ? (imageSize - offset) : kPageSize;
+            memset(pageBuffer.data(), flashUpdater.get_erase_value(), kPageSize);
+            memcpy(pageBuffer.data(), &image[offset], size);
+            result = flashUpdater.writePage(kPageSize, pageBuffer.data(), readPageBuffer.data(),
+                                            address, sectorErased, pagesFlashed, nextSectorAddress);
+        }
+        measurement.report(result);
+    }
+
+    // read it back
+    {
+        Measurement measurement("readPage", parameters);
+        uint32_t address = slotAddress;
+        int32_t result = UC_ERR_NONE;
+        while (address < slotAddress + imageSize && result == UC_ERR_NONE) {
+            result = flashUpdater.readPage(kPageSize, readPageBuffer.data(), address);
+        }
+        measurement.report(result);
+    }
+
+    // align every page address of the image in both directions
+    {
+        Measurement measurement("alignAddressToSector", parameters);
+        uint32_t checksum = 0;
+        for (uint32_t address = slotAddress; address < slotAddress + imageSize; address += kPageSize) {
+            checksum += flashUpdater.alignAddressToSector(address, true);
+            checksum += flashUpdater.alignAddressToSector(address + 1, false);
+        }
+        measurement.report((checksum == 0) ? UC_ERR_INVALID_PARAMETER : UC_ERR_NONE);
+    }
+
+    // hash the application from a new instance, which has no cached result
+    {
+        MbedApplication application(flashUpdater, slotAddress, slotAddress + headerSize);
+        Measurement measurement("checkApplication", parameters);
+        const int32_t result = application.checkApplication();
+        measurement.report(result);
+    }
+
+#if defined(POST_APPLICATION_ADDR)
+    // install over the active application, then again when the destination is unchanged
+    CandidateApplications candidateApplications(flashUpdater, storageAddress, storageSize, headerSize,
+                                                parameters.nbrOfSlots);
+    const CandidateApplications::InstallMode installModes[] = {
+        CandidateApplications::INSTALL_ALL_SECTORS,
+        CandidateApplications::INSTALL_CHANGED_SECTORS
+    };
+    const char *installModeNames[] = { "installApplication", "installApplication(=)" };
+    for (uint32_t modeIndex = 0; modeIndex < sizeof(installModes) / sizeof(installModes[0]); modeIndex++) {
+        Measurement measurement(installModeNames[modeIndex], parameters);
+        uint32_t nbrOfSectorsWritten = 0;
+        const int32_t result = candidateApplications.installApplication(slotIndex, HEADER_ADDR, installModes[modeIndex],
+                                                                        nbrOfSectorsWritten);
+        measurement.report(result);
+    }
+#endif
+}
+
+} // namespace
+
+int main()
+{
+    const uint32_t flashStart = HEADER_ADDR - (HEADER_ADDR % kFlashSize);
+    const uint32_t storageAddress = flashStart + kFlashSize / 2;
+    const uint32_t storageSize = kFlashSize / 2;
+    if (MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS < 4) {
+        printf("Slot counts above %u are skipped (update-client.storage-locations)\n",
+               (unsigned) MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS);
+    }
+
+    printf("%-22s %-11s %-6s %7s %5s %10s %12s %7s %7s %6s %6s\n", "operation", "layout", "dest", "bytes",
+           "slots", "host us", "modeled us", "reads", "progs", "erases", "result");
+    for (const Layout &layout : kLayouts) {
+        if (SimFlashDevice::getDefault().configure(flashStart, kPageSize, layout.sectorRegions,
+                                                   layout.nbrOfSectorRegions, layout.costModel) != UC_ERR_NONE) {
+            printf("Cannot configure the simulated flash for the %s layout\n", layout.pName);
+            return 1;
+        }
+        // the sector map is indexed when the flash updater is initialized
+        FlashUpdater flashUpdater;
+        if (flashUpdater.init() != 0) {
+            printf("Cannot initialize the flash updater\n");
+            return 1;
+        }
+        if (flashUpdater.alignAddressToSector(HEADER_ADDR, true) != HEADER_ADDR) {
+            printf("HEADER_ADDR is not on a sector boundary of the %s layout, skipped\n", layout.pName);
+            flashUpdater.deinit();
+            continue;
+        }
+
+        for (uint32_t imageSize : kImageSizes) {
+            if (HEADER_ADDR + imageSize > storageAddress) {
+                continue;
+            }
+            for (uint32_t nbrOfSlots : kNbrOfSlots) {
+                if (nbrOfSlots > MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS) {
+                    continue;
+                }
+                for (uint32_t blankIndex = 0; blankIndex < 2; blankIndex++) {
+                    const RunParameters parameters = { layout.pName, blankIndex == 0, imageSize, nbrOfSlots };
+                    runBenchmark(flashUpdater, storageAddress, storageSize, parameters);
+                }
+            }
+        }
+
+        flashUpdater.deinit();
+    }
+
+    return 0;
+}
@@ -0,0 +1,389 @@
+// Host benchmark of updates received by FirmwareDownloader over SocketTransport
+// A host thread sends images of several sizes over a Unix domain socket, as a raw stream or
+// with the framed protocol depending on update-client.framed-protocol, while the downloader
+// receives them into the candidate slot of the simulated flash, as it does on the target.
+// Each update is received with downloadFirmware(), so that its result is known, and measured
+// from the connection until the image is validated. It reports the throughput on the host
+// with the flash operations counted by SimFlashDevice and the time they would take on the
+// modeled device
+// Build on the host with the mbed.h replacement of benchmarks/host, for example:
+//   g++ -std=c++14 -O2 -DUSE_SIMULATED_FLASH_UC=1 -DUSE_SOCKET_TRANSPORT_UC=1
+//       [-DMBED_CONF_UPDATE_CLIENT_FRAMED_PROTOCOL=1] -Ibenchmarks/host -I.
+//       benchmarks/socket_transfer_benchmark.cpp <update client sources> -lmbedcrypto -pthread
+// The socket path may be given on the command line
+
+#include "firmware_downloader.hpp"
+#include "frame_protocol.hpp"
+#include "mbed_application.hpp"
+#include "sim_flash_iap.hpp"
+#include "socket_transport.hpp"
+#include "uc_crc32.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbedtls/sha256.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace update_client;
+
+namespace {
+
+// the modeled device has 4 KiB sectors and 256 bytes pages, it covers the active
+// application, the storage and the metadata areas of the configuration
+constexpr uint32_t kPageSize = 256;
+constexpr uint32_t kSectorSize = 4096;
+constexpr SimFlashDevice::CostModel kCostModel = { 25000, 0, 400, 20000 };
+
+constexpr uint32_t kImageSizes[] = { 64 * 1024, 256 * 1024, 768 * 1024 };
+constexpr const char *kDefaultSocketPath = "/tmp/uc_socket_transfer_benchmark";
+// time after which the host sends again the frames that were not acknowledged, it gives up
+// after consecutive timeouts
+constexpr uint32_t kResponseTimeoutMs = 2 * MBED_CONF_UPDATE_CLIENT_TRANSFER_TIMEOUT;
+constexpr uint32_t kMaxNbrOfTimeouts = 5;
+
+// V2 header layout, see MbedApplication
+constexpr uint32_t kHeaderMagicV2 = 0x5a51b3d4UL;
+constexpr uint32_t kHeaderVersionV2 = 2;
+constexpr uint32_t kFirmwareVersionOffset = 8;
+constexpr uint32_t kFirmwareSizeOffset = 16;
+constexpr uint32_t kHashOffset = 24;
+constexpr uint32_t kHeaderCrcOffset = 108;
+
+// the host end of the socket, for sending with FrameProtocol
+class ClientTransport :
+    public Transport {
+public:
+    explicit ClientTransport(const char *pSocketPath) :
+        _pSocketPath(pSocketPath),
+        _socket(-1)
+    {
+    }
+
+    virtual ~ClientTransport()
+    {
+        close();
+    }
+
+    virtual int32_t open()
+    {
+        _socket = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s", _pSocketPath);
+        if (_socket < 0 || connect(_socket, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0) {
+            close();
+            return UC_ERR_DISCONNECTED;
+        }
+
+        return UC_ERR_NONE;
+    }
+
+    virtual void close()
+    {
+        if (_socket >= 0) {
+            ::close(_socket);
+            _socket = -1;
+        }
+    }
+
+    virtual int32_t waitForConnection(uint32_t timeoutMs)
+    {
+        (void) timeoutMs;
+        return isConnected() ? UC_ERR_NONE : UC_ERR_DISCONNECTED;
+    }
+
+    virtual bool isConnected()
+    {
+        return _socket >= 0;
+    }
+
+    virtual int32_t read(uint8_t *pBuffer, uint32_t size, uint32_t timeoutMs, uint32_t &nbrOfBytesRead)
+    {
+        nbrOfBytesRead = 0;
+        struct pollfd pollFd;
+        pollFd.fd = _socket;
+        pollFd.events = POLLIN;
+        pollFd.revents = 0;
+        const int count = poll(&pollFd, 1, (timeoutMs == kWaitForever) ? -1 : (int) timeoutMs);
+        if (count == 0) {
+            return UC_ERR_TIMEOUT;
+        }
+        const ssize_t nbrOfBytes = (count > 0) ? recv(_socket, pBuffer, size, 0) : -1;
+        if (nbrOfBytes <= 0) {
+            return UC_ERR_DISCONNECTED;
+        }
+        nbrOfBytesRead = (uint32_t) nbrOfBytes;
+
+        return UC_ERR_NONE;
+    }
+
+    virtual int32_t write(const uint8_t *pBuffer, uint32_t size)
+    {
+        uint32_t nbrOfBytesWritten = 0;
+        while (nbrOfBytesWritten < size) {
+            const ssize_t count = send(_socket, &pBuffer[nbrOfBytesWritten], size - nbrOfBytesWritten, MSG_NOSIGNAL);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return UC_ERR_DISCONNECTED;
+            }
+            nbrOfBytesWritten += (uint32_t) count;
+        }
+
+        return UC_ERR_NONE;
+    }
+
+    virtual void cancel()
+    {
+    }
+
+    // no more data is sent, the device sees the end of a raw stream
+    void shutdownWrite()
+    {
+        shutdown(_socket, SHUT_WR);
+    }
+
+private:
+    const char *_pSocketPath;
+    int _socket;
+};
+
+void writeUint32(uint8_t *pBuffer, uint32_t value)
+{
+    pBuffer[0] = (uint8_t)(value >> 24);
+    pBuffer[1] = (uint8_t)(value >> 16);
+    pBuffer[2] = (uint8_t)(value >> 8);
+    pBuffer[3] = (uint8_t) value;
+}
+
+// an image with a valid header, followed by firmware that compresses like code
+std::vector<uint8_t> buildImage(uint32_t headerSize, uint32_t firmwareSize)
+{
+    std::vector<uint8_t> image(headerSize + firmwareSize, 0xFF);
+    uint8_t *pFirmware = &image[headerSize];
+    uint32_t seed = 0x12345678;
+    for (uint32_t index = 0; index < firmwareSize; index++) {
+        seed = seed * 1103515245 + 12345;
+        pFirmware[index] = ((index % 64) < 48) ? (uint8_t)(index / 4) : (uint8_t)(seed >> 24);
+    }
+
+    uint8_t *pHeader = image.data();
+    memset(pHeader, 0, MbedApplication::kHeaderSizeV2);
+    writeUint32(&pHeader[0], kHeaderMagicV2);
+    writeUint32(&pHeader[4], kHeaderVersionV2);
+    writeUint32(&pHeader[kFirmwareVersionOffset + 4], 1);
+    writeUint32(&pHeader[kFirmwareSizeOffset + 4], firmwareSize);
+    mbedtls_sha256_context shaContext;
+    mbedtls_sha256_init(&shaContext);
+    mbedtls_sha256_starts(&shaContext, 0);
+    mbedtls_sha256_update(&shaContext, pFirmware, firmwareSize);
+    mbedtls_sha256_finish(&shaContext, &pHeader[kHashOffset]);
+    mbedtls_sha256_free(&shaContext);
+    writeUint32(&pHeader[kHeaderCrcOffset], crc32(pHeader, kHeaderCrcOffset));
+
+    return image;
+}
+
+// send the image as a stream, the end of the image is the end of the stream
+int32_t sendRaw(ClientTransport &transport, const std::vector<uint8_t> &image)
+{
+    int32_t result = transport.write(image.data(), (uint32_t) image.size());
+    transport.shutdownWrite();
+
+    return result;
+}
+
+// FrameProtocol only sends control frames, data frames are encoded here in the same format
+int32_t sendDataFrame(Transport &transport, uint32_t sequence, uint32_t offset, const uint8_t *pData,
+                      uint32_t size)
+{
+    const uint32_t length = 4 + size;
+    std::vector<uint8_t> frame(FrameProtocol::kHeaderSize + length + FrameProtocol::kCrcSize);
+    frame[0] = FrameProtocol::kSyncByte;
+    frame[1] = FrameProtocol::FRAME_DATA;
+    frame[2] = (uint8_t)(length & 0xFF);
+    frame[3] = (uint8_t)(length >> 8);
+    FrameProtocol::writeUint32(&frame[4], sequence);
+    FrameProtocol::writeUint32(&frame[FrameProtocol::kHeaderSize], offset);
+    memcpy(&frame[FrameProtocol::kHeaderSize + 4], pData, size);
+    FrameProtocol::writeUint32(&frame[FrameProtocol::kHeaderSize + length],
+                               crc32(&frame[1], FrameProtocol::kHeaderSize - 1 + length));
+
+    return transport.write(frame.data(), (uint32_t) frame.size());
+}
+
+// send the image with the framed protocol and return the result reported by the device
+int32_t sendFrames(ClientTransport &transport, const std::vector<uint8_t> &image, uint32_t imageId)
+{
+    FrameProtocol frameProtocol(transport, MBED_CONF_UPDATE_CLIENT_FRAME_PAYLOAD_SIZE);
+    uint8_t payload[12];
+    FrameProtocol::writeUint32(&payload[0], imageId);
+    FrameProtocol::writeUint32(&payload[4], (uint32_t) image.size());
+    FrameProtocol::writeUint32(&payload[8], 0);
+    int32_t result = frameProtocol.sendFrame(FrameProtocol::FRAME_HELLO, 0, payload, sizeof(payload));
+
+    FrameProtocol::Frame frame;
+    while (result == UC_ERR_NONE) {
+        result = frameProtocol.receiveFrame(frame, kResponseTimeoutMs);
+        if (result != UC_ERR_NONE || frame.type == FrameProtocol::FRAME_HELLO_ACK) {
+            break;
+        }
+        if (frame.type == FrameProtocol::FRAME_RESULT && frame.length >= 4) {
+            return (int32_t) FrameProtocol::parseUint32(frame.pPayload);
+        }
+    }
+    if (result != UC_ERR_NONE || frame.length < 16) {
+        return (result != UC_ERR_NONE) ? result : UC_ERR_INVALID_PARAMETER;
+    }
+    const uint32_t resumeOffset = FrameProtocol::parseUint32(&frame.pPayload[0]);
+    const uint32_t maxPayloadSize = FrameProtocol::parseUint32(&frame.pPayload[4]);
+    const uint32_t windowSize = FrameProtocol::parseUint32(&frame.pPayload[8]);
+    const uint32_t headerResendSize = FrameProtocol::parseUint32(&frame.pPayload[12]);
+    if (maxPayloadSize <= 4 || maxPayloadSize > 0xFFFF || windowSize == 0) {
+        return UC_ERR_INVALID_PARAMETER;
+    }
+
+    // offsets of the data frames, the header first if the device asks for it again
+    std::vector<uint32_t> frameOffsets;
+    const uint32_t maxDataSize = maxPayloadSize - 4;
+    for (uint32_t offset = 0; offset < headerResendSize; offset += maxDataSize) {
+        frameOffsets.push_back(offset);
+    }
+    for (uint32_t offset = resumeOffset; offset < image.size(); offset += maxDataSize) {
+        frameOffsets.push_back(offset);
+    }
+    const uint32_t nbrOfFrames = (uint32_t) frameOffsets.size();
+
+    // frames are sent ahead of the acknowledgements, up to the window, and sent again from the
+    // expected sequence on a NAK or when the device goes silent
+    uint32_t firstUnacknowledged = 0;
+    uint32_t nextSequence = 0;
+    bool endSent = false;
+    uint32_t nbrOfTimeouts = 0;
+    while (true) {
+        while (nextSequence < nbrOfFrames && nextSequence - firstUnacknowledged < windowSize) {
+            const uint32_t offset = frameOffsets[nextSequence];
+            const uint32_t limit = (offset < headerResendSize) ? headerResendSize : (uint32_t) image.size();
+            const uint32_t dataSize = std::min(maxDataSize, limit - offset);
+            result = sendDataFrame(transport, nextSequence, offset, &image[offset], dataSize);
+            if (result != UC_ERR_NONE) {
+                return result;
+            }
+            nextSequence++;
+        }
+        if (nextSequence == nbrOfFrames && ! endSent) {
+            result = frameProtocol.sendFrame(FrameProtocol::FRAME_END, nbrOfFrames, NULL, 0);
+            if (result != UC_ERR_NONE) {
+                return result;
+            }
+            endSent = true;
+        }
+
+        // acknowledgements are only waited for when nothing else can be sent
+        const bool canSend = (nextSequence < nbrOfFrames && nextSequence - firstUnacknowledged < windowSize);
+        result = frameProtocol.receiveFrame(frame, canSend ? 0 : kResponseTimeoutMs);
+        if (result == UC_ERR_TIMEOUT) {
+            if (! canSend) {
+                if (++nbrOfTimeouts >= kMaxNbrOfTimeouts) {
+                    return result;
+                }
+                nextSequence = firstUnacknowledged;
+                endSent = false;
+            }
+            continue;
+        }
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        nbrOfTimeouts = 0;
+        if (frame.type == FrameProtocol::FRAME_RESULT && frame.length >= 4) {
+            return (int32_t) FrameProtocol::parseUint32(frame.pPayload);
+        }
+        if (frame.type == FrameProtocol::FRAME_ACK && frame.sequence > firstUnacknowledged &&
+                frame.sequence <= nextSequence) {
+            firstUnacknowledged = frame.sequence;
+        } else if (frame.type == FrameProtocol::FRAME_NAK && frame.sequence <= nbrOfFrames) {
+            firstUnacknowledged = frame.sequence;
+            nextSequence = frame.sequence;
+            endSent = false;
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    const char *pSocketPath = (argc > 1) ? argv[1] : kDefaultSocketPath;
+    const SimFlashDevice::SectorRegion sectorRegion = { kSectorSize, MBED_ROM_SIZE / kSectorSize };
+    SimFlashDevice &device = SimFlashDevice::getDefault();
+    if (device.configure(MBED_ROM_START, kPageSize, &sectorRegion, 1, kCostModel) != UC_ERR_NONE) {
+        printf("Cannot configure the simulated flash\n");
+        return 1;
+    }
+
+    SocketTransport transport(pSocketPath);
+    if (transport.open() != UC_ERR_NONE) {
+        printf("Cannot listen on %s\n", pSocketPath);
+        return 1;
+    }
+    FirmwareDownloader firmwareDownloader(transport);
+    const bool isFramed = (MBED_CONF_UPDATE_CLIENT_FRAMED_PROTOCOL == 1);
+    const uint32_t headerSize = APPLICATION_ADDR - HEADER_ADDR;
+
+    printf("%-6s %7s %10s %10s %12s %7s %6s %6s %6s\n", "mode", "bytes", "host ms", "KB/s",
+           "modeled ms", "progs", "erases", "sent", "result");
+    int exitCode = 0;
+    for (uint32_t imageIndex = 0; imageIndex < sizeof(kImageSizes) / sizeof(kImageSizes[0]); imageIndex++) {
+        const uint32_t imageSize = kImageSizes[imageIndex];
+        const std::vector<uint8_t> image = buildImage(headerSize, imageSize - headerSize);
+        device.resetStats();
+        const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+        // the host connects and sends while the downloader receives the update
+        int32_t sendResult = UC_ERR_NONE;
+        std::thread hostThread([&]() {
+            ClientTransport clientTransport(pSocketPath);
+            sendResult = clientTransport.open();
+            if (sendResult == UC_ERR_NONE) {
+                sendResult = isFramed ? sendFrames(clientTransport, image, imageIndex + 1)
+                                      : sendRaw(clientTransport, image);
+            }
+            clientTransport.close();
+        });
+        int32_t result = transport.waitForConnection(Transport::kWaitForever);
+        if (result == UC_ERR_NONE) {
+            result = firmwareDownloader.downloadFirmware();
+        }
+        // a new wait drops the connection, which ends a host still sending after an error
+        transport.waitForConnection(0);
+        hostThread.join();
+
+        const double durationMs = std::chrono::duration<double, std::milli>(
+                                      std::chrono::steady_clock::now() - startTime).count();
+        const SimFlashDevice::Stats &stats = device.getStats();
+        printf("%-6s %7" PRIu32 " %10.1f %10.1f %12.1f %7" PRIu32 " %6" PRIu32 " %6" PRIi32 " %6" PRIi32 "\n",
+               isFramed ? "framed" : "raw", imageSize, durationMs, imageSize / 1024.0 / (durationMs / 1000.0),
+               stats.modeledTimeNs / 1e6, stats.nbrOfPrograms, stats.nbrOfErases, sendResult, result);
+        if (result != UC_ERR_NONE || sendResult != UC_ERR_NONE) {
+            exitCode = 1;
+        }
+    }
+    transport.close();
+
+    return exitCode;
+}
@@ -0,0 +1,47 @@
+#include "boot_slot_record.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "BootSlotRecord"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+BootSlotRecord::BootSlotRecord(FlashRecordLog &recordLog) :
+    _recordLog(recordLog)
+{
+
+}
+
+bool BootSlotRecord::getBootSlot(uint32_t &headerAddress, uint32_t &headerCrc, uint64_t &firmwareVersion)
+{
+    FlashRecordLog::Record record;
+    if (_recordLog.find(kBootSlotRecordType, kBootSlotKey, record) != UC_ERR_NONE) {
+        return false;
+    }
+    headerAddress = record.values[0];
+    headerCrc = record.values[1];
+    firmwareVersion = ((uint64_t) record.values[3] << 32) | record.values[2];
+
+    return true;
+}
+
+int32_t BootSlotRecord::setBootSlot(uint32_t headerAddress, uint32_t headerCrc, uint64_t firmwareVersion)
+{
+    tr_debug(" Booting application at address 0x%08" PRIx32 " (version %" PRIu64 ")", headerAddress, firmwareVersion);
+    const uint32_t values[FlashRecordLog::kNbrOfValues] = {
+        headerAddress,
+        headerCrc,
+        (uint32_t) firmwareVersion,
+        (uint32_t)(firmwareVersion >> 32)
+    };
+    return _recordLog.write(kBootSlotRecordType, kBootSlotKey, values);
+}
+
+int32_t BootSlotRecord::clear()
+{
+    return _recordLog.remove(kBootSlotRecordType, kBootSlotKey);
+}
+
+} // namespace update_client
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "flash_record_log.hpp"
+
+namespace update_client {
+
+// BootSlotRecord remembers the slot the bootloader starts the application from, when a
+// candidate is activated in place instead of being copied to the active application
+// The record identifies the application by its header CRC and firmware version, so that
+// it is ignored once the slot is rewritten. Without a record, the active application boots
+
+class BootSlotRecord {
+public:
+    // constructor
+    explicit BootSlotRecord(FlashRecordLog &recordLog);
+
+    // returns true if a boot slot is recorded, with the header address and CRC of its application
+    bool getBootSlot(uint32_t &headerAddress, uint32_t &headerCrc, uint64_t &firmwareVersion);
+    int32_t setBootSlot(uint32_t headerAddress, uint32_t headerCrc, uint64_t firmwareVersion);
+    // boot the active application again
+    int32_t clear();
+
+private:
+    // data members
+    FlashRecordLog &_recordLog;
+
+    // record types are unique among the users of the log, there is a single boot slot
+    static constexpr uint16_t kBootSlotRecordType = 4;
+    static constexpr uint32_t kBootSlotKey = 0;
+};
+
+} // namespace update_client
@@ -0,0 +1,116 @@
+#include "buffered_serial_transport.hpp"
+#include "uc_error_codes.hpp"
+
+#include <cerrno>
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "BufferedSerialTransport"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+#if (USE_BUFFERED_SERIAL_UC == 1)
+
+BufferedSerialTransport::BufferedSerialTransport(PinName tx, PinName rx, int baud) :
+    _serial(tx, rx, baud)
+{
+
+}
+
+int32_t BufferedSerialTransport::open()
+{
+    _events.clear();
+    _serial.set_blocking(false);
+    _serial.sigio(callback(this, &BufferedSerialTransport::onSigio));
+
+    return UC_ERR_NONE;
+}
+
+void BufferedSerialTransport::close()
+{
+    _serial.sigio(nullptr);
+}
+
+int32_t BufferedSerialTransport::waitForConnection(uint32_t timeoutMs)
+{
+    // the host is connected once it sends data, which is left for read()
+    while (! _serial.readable()) {
+        const uint32_t flags = _events.wait_any(IO_EVENT_FLAG | CANCEL_EVENT_FLAG, timeoutMs, false);
+        if ((flags & osFlagsError) != 0) {
+            return UC_ERR_TIMEOUT;
+        }
+        if ((flags & CANCEL_EVENT_FLAG) != 0) {
+            return UC_ERR_CANCELLED;
+        }
+        _events.clear(IO_EVENT_FLAG);
+    }
+
+    return ((_events.get() & CANCEL_EVENT_FLAG) != 0) ? UC_ERR_CANCELLED : UC_ERR_NONE;
+}
+
+bool BufferedSerialTransport::isConnected()
+{
+    return true;
+}
+
+int32_t BufferedSerialTransport::read(uint8_t *pBuffer, uint32_t size, uint32_t timeoutMs, uint32_t &nbrOfBytesRead)
+{
+    nbrOfBytesRead = 0;
+    while (true) {
+        const ssize_t count = _serial.read(pBuffer, size);
+        if (count > 0) {
+            nbrOfBytesRead = (uint32_t) count;
+            return UC_ERR_NONE;
+        }
+
+        // sigio is also raised when the serial becomes writable, so wake ups may be spurious
+        const uint32_t flags = _events.wait_any(IO_EVENT_FLAG | CANCEL_EVENT_FLAG, timeoutMs, false);
+        if ((flags & osFlagsError) != 0) {
+            return UC_ERR_TIMEOUT;
+        }
+        if ((flags & CANCEL_EVENT_FLAG) != 0) {
+            return UC_ERR_CANCELLED;
+        }
+        _events.clear(IO_EVENT_FLAG);
+    }
+}
+
+int32_t BufferedSerialTransport::write(const uint8_t *pBuffer, uint32_t size)
+{
+    uint32_t nbrOfBytesWritten = 0;
+    while (nbrOfBytesWritten < size) {
+        const ssize_t count = _serial.write(&pBuffer[nbrOfBytesWritten], size - nbrOfBytesWritten);
+        if (count > 0) {
+            nbrOfBytesWritten += (uint32_t) count;
+            continue;
+        }
+        if (count != -EAGAIN) {
+            tr_error("Serial write failed: %d", (int) count);
+            return UC_ERR_DISCONNECTED;
+        }
+
+        // wait until the transmit buffer drains
+        const uint32_t flags = _events.wait_any(IO_EVENT_FLAG | CANCEL_EVENT_FLAG, osWaitForever, false);
+        if ((flags & CANCEL_EVENT_FLAG) != 0) {
+            return UC_ERR_CANCELLED;
+        }
+        _events.clear(IO_EVENT_FLAG);
+    }
+
+    return UC_ERR_NONE;
+}
+
+void BufferedSerialTransport::cancel()
+{
+    _events.set(CANCEL_EVENT_FLAG);
+}
+
+void BufferedSerialTransport::onSigio()
+{
+    _events.set(IO_EVENT_FLAG);
+}
+
+#endif // USE_BUFFERED_SERIAL_UC
+
+} // namespace update_client
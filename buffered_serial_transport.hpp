@@ -0,0 +1,43 @@
+#pragma once
+
+#include "mbed.h"
+
+#include "uc_transport.hpp"
+
+namespace update_client {
+
+#if (USE_BUFFERED_SERIAL_UC == 1)
+
+// BufferedSerialTransport is a transport over a UART
+// A UART has no notion of connection: the host is considered connected as soon as data is
+// received, and the end of a transfer is detected by the downloader with a read timeout
+
+class BufferedSerialTransport :
+    public Transport {
+public:
+    BufferedSerialTransport(PinName tx, PinName rx, int baud);
+
+    virtual int32_t open();
+    virtual void close();
+    virtual int32_t waitForConnection(uint32_t timeoutMs);
+    virtual bool isConnected();
+    virtual int32_t read(uint8_t *pBuffer, uint32_t size, uint32_t timeoutMs, uint32_t &nbrOfBytesRead);
+    virtual int32_t write(const uint8_t *pBuffer, uint32_t size);
+    virtual void cancel();
+
+private:
+    // called from the interrupt context when the serial becomes readable or writable
+    void onSigio();
+
+    // data members
+    enum {
+        CANCEL_EVENT_FLAG = 1,
+        IO_EVENT_FLAG = 2
+    };
+    EventFlags _events;
+    BufferedSerial _serial;
+};
+
+#endif // USE_BUFFERED_SERIAL_UC
+
+} // namespace update_client
@@ -1,5 +1,7 @@
 #include "candidate_applications.hpp"
+#include "flash_stream_writer.hpp"
 #include "flash_updater.hpp"
+#include "uc_arena.hpp"
 #include "uc_error_codes.hpp"
 #include <cstdint>
 
@@ -27,8 +29,29 @@ CandidateApplications::CandidateApplications(FlashUpdater &flashUpdater,
     _flashUpdater(flashUpdater),
     _storageAddress(storageAddress),
     _storageSize(storageSize),
-    _nbrOfSlots(nbrOfSlots)
+    _headerSize(headerSize),
+    _nbrOfSlots(nbrOfSlots),
+    _useBoardGeometry(false),
+    _verificationCache(NULL),
+    _installJournal(NULL),
+    _bootSlotRecord(NULL),
+    _slotWearRecord(NULL),
+    _downloadProgress(NULL),
+    _slotMetadataIndex(flashUpdater)
 {
+    memset(_candidateApplicationArray, 0, sizeof(_candidateApplicationArray));
+
+#if (MBED_CONF_UPDATE_CLIENT_UNIFORM_SECTOR_SIZE > 0)
+    // the slot layout computed at compile time is used if it describes this storage
+    _useBoardGeometry = (storageAddress == MBED_CONF_UPDATE_CLIENT_STORAGE_ADDRESS &&
+                         storageSize == MBED_CONF_UPDATE_CLIENT_STORAGE_SIZE &&
+                         nbrOfSlots == BoardFlashGeometry::kNbrOfSlots &&
+                         _flashUpdater.getSectorSize(BoardFlashGeometry::kStorageStartAddress) == BoardFlashGeometry::kSectorSize);
+    if (! _useBoardGeometry) {
+        tr_error(" Board flash geometry does not match the storage, using the sector map");
+    }
+#endif
+
     // the number of slots must be equal or smaller than MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS
     if (nbrOfSlots <= MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS) {
         for (uint32_t slotIndex = 0; slotIndex < nbrOfSlots; slotIndex++) {
@@ -42,9 +65,8 @@ CandidateApplications::CandidateApplications(FlashUpdater &flashUpdater,
 
             tr_debug(" Slot %" PRIu32 ": application header address: 0x%08" PRIx32 " application address 0x%08" PRIx32 " (slot size %" PRIu32 ")",
                      slotIndex, candidateAddress, candidateAddress + headerSize, slotSize);
-            _candidateApplicationArray[slotIndex] = new update_client::MbedApplication(_flashUpdater,
-                                                                                       candidateAddress,
-                                                                                       candidateAddress + headerSize);
+            // a slot without a valid header is recorded as such in the index
+            _slotMetadataIndex.readSlot(slotIndex, candidateAddress);
         }
     }
 }
@@ -57,10 +79,50 @@ CandidateApplications::~CandidateApplications()
     }
 }
 
+void *CandidateApplications::operator new(size_t size)
+{
+    return UpdateClientArena::allocate(size);
+}
+
+void CandidateApplications::operator delete(void *pMemory)
+{
+    UpdateClientArena::release(pMemory);
+}
+
 uint32_t CandidateApplications::getSlotForCandidate()
 {
-    // default implementation, always returns 0
-    return 0;
+    // default implementation, only the slot metadata is used so that no slot is hashed
+    uint32_t bootSlotIndex = _nbrOfSlots;
+    if (! getBootSlot(bootSlotIndex)) {
+        bootSlotIndex = _nbrOfSlots;
+    }
+    uint32_t newestSlotIndex = _nbrOfSlots;
+    if (! getNewestSlot(newestSlotIndex)) {
+        newestSlotIndex = _nbrOfSlots;
+    }
+
+    // the slot with the lowest rank is chosen, then the one with the fewest erase cycles,
+    // then older applications and lower slot indexes
+    uint32_t selectedSlotIndex = 0;
+    uint32_t selectedEraseCount = 0;
+    uint32_t selectedRank = getSlotRank(0, bootSlotIndex, newestSlotIndex, selectedEraseCount);
+    for (uint32_t slotIndex = 1; slotIndex < _nbrOfSlots; slotIndex++) {
+        uint32_t eraseCount = 0;
+        const uint32_t rank = getSlotRank(slotIndex, bootSlotIndex, newestSlotIndex, eraseCount);
+        if (rank < selectedRank ||
+                (rank == selectedRank && eraseCount < selectedEraseCount) ||
+                (rank == selectedRank && eraseCount == selectedEraseCount &&
+                 _slotMetadataIndex.isCandidate(slotIndex) &&
+                 getFirmwareVersion(slotIndex) < getFirmwareVersion(selectedSlotIndex))) {
+            selectedSlotIndex = slotIndex;
+            selectedEraseCount = eraseCount;
+            selectedRank = rank;
+        }
+    }
+    tr_debug(" Slot %" PRIu32 " selected for the candidate (rank %" PRIu32 ", %" PRIu32 " erase cycles)",
+             selectedSlotIndex, selectedRank, selectedEraseCount);
+
+    return selectedSlotIndex;
 }
 
 uint32_t CandidateApplications::getNbrOfSlots() const 
@@ -70,6 +132,92 @@ uint32_t CandidateApplications::getNbrOfSlots() const
 
 MbedApplication &CandidateApplications::getMbedApplication(uint32_t slotIndex)
 {
+    return getApplication(slotIndex);
+}
+
+uint64_t CandidateApplications::getFirmwareVersion(uint32_t slotIndex) const
+{
+    return _slotMetadataIndex.getFirmwareVersion(slotIndex);
+}
+
+uint64_t CandidateApplications::getFirmwareSize(uint32_t slotIndex) const
+{
+    return _slotMetadataIndex.getFirmwareSize(slotIndex);
+}
+
+bool CandidateApplications::isNewerThan(uint32_t slotIndex, MbedApplication &otherApplication) const
+{
+    return _slotMetadataIndex.isNewerThan(slotIndex, otherApplication);
+}
+
+bool CandidateApplications::getNewestSlot(uint32_t &newestSlotIndex) const
+{
+    return _slotMetadataIndex.getNewestSlot(_nbrOfSlots, newestSlotIndex);
+}
+
+uint32_t CandidateApplications::getSlotRank(uint32_t slotIndex, uint32_t bootSlotIndex, uint32_t newestSlotIndex,
+                                            uint32_t &eraseCount)
+{
+    enum SlotRank {
+        // a partially downloaded image, its transfer can be resumed
+        RANK_PARTIAL_DOWNLOAD,
+        // an erased slot, no erase is needed
+        RANK_BLANK,
+        // no valid header, an incomplete or corrupted image
+        RANK_NOT_VALID,
+        // an application that is not the newest one
+        RANK_OLDER_APPLICATION,
+        // the newest application, which the bootloader falls back to
+        RANK_NEWEST_APPLICATION,
+        // the application is started from the slot
+        RANK_BOOT_SLOT
+    };
+
+    eraseCount = 0;
+    uint32_t candidateAddress = 0;
+    uint32_t slotSize = 0;
+    if (getCandidateAddress(slotIndex, candidateAddress, slotSize) != UC_ERR_NONE) {
+        return RANK_BOOT_SLOT;
+    }
+    bool isBlank = false;
+    if (_slotWearRecord != NULL) {
+        _slotWearRecord->getSlotWear(candidateAddress, eraseCount, isBlank);
+    }
+
+    if (slotIndex == bootSlotIndex) {
+        return RANK_BOOT_SLOT;
+    }
+    if (slotIndex == newestSlotIndex) {
+        return RANK_NEWEST_APPLICATION;
+    }
+    if (_slotMetadataIndex.isCandidate(slotIndex)) {
+        return RANK_OLDER_APPLICATION;
+    }
+    // the header of a partial image is only written once it is complete
+    if (_slotMetadataIndex.getState(slotIndex) == SlotMetadataIndex::SLOT_NOT_VALID) {
+        if (_downloadProgress != NULL && _downloadProgress->isInProgress(candidateAddress)) {
+            return RANK_PARTIAL_DOWNLOAD;
+        }
+        if (isBlank) {
+            return RANK_BLANK;
+        }
+    }
+
+    return RANK_NOT_VALID;
+}
+
+MbedApplication &CandidateApplications::getApplication(uint32_t slotIndex) const
+{
+    if (_candidateApplicationArray[slotIndex] == NULL) {
+        uint32_t candidateAddress = 0;
+        uint32_t slotSize = 0;
+        getCandidateAddress(slotIndex, candidateAddress, slotSize);
+        _candidateApplicationArray[slotIndex] = new update_client::MbedApplication(_flashUpdater,
+                                                                                   candidateAddress,
+                                                                                   candidateAddress + _headerSize);
+        _candidateApplicationArray[slotIndex]->setVerificationCache(_verificationCache);
+    }
+
     return *_candidateApplicationArray[slotIndex];
 }
 
@@ -78,6 +226,14 @@ int32_t CandidateApplications::getCandidateAddress(uint32_t slotIndex,
                                                    uint32_t &candidateAddress,
                                                    uint32_t &slotSize) const
 {
+#if (MBED_CONF_UPDATE_CLIENT_UNIFORM_SECTOR_SIZE > 0)
+    if (_useBoardGeometry) {
+        candidateAddress = BoardFlashGeometry::getSlotAddress(slotIndex);
+        slotSize = BoardFlashGeometry::getSlotSize(slotIndex);
+        return UC_ERR_NONE;
+    }
+#endif
+
     // find the start address of the whole storage area. It needs to be aligned to
     // sector boundary and we cannot go outside user defined storage area, hence
     // rounding up to sector boundary
@@ -143,47 +299,237 @@ bool CandidateApplications::hasValidNewerApplication(MbedApplication &activeAppl
 {
     tr_debug(" Checking for newer applications on %" PRIu32 " slots", _nbrOfSlots);
     newestSlotIndex = _nbrOfSlots;
+
+    // Only hash check firmwares with higher version number than the
+    // active image. This prevents rollbacks and hash checks of old images.
+    // Candidates are ranked by firmware version using the headers only,
+    // so that only the newest candidate is hashed unless it is not valid
+    uint32_t rankedSlotArray[MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS];
+    uint32_t nbrOfRankedSlots = 0;
     for (uint32_t slotIndex = 0; slotIndex < _nbrOfSlots; slotIndex++) {
-        // Only hash check firmwares with higher version number than the
-        // active image and with a different hash. This prevents rollbacks
-        // and hash checks of old images. If the active image is not valid,
-        // bestStoredFirmwareImageDetails.version equals 0
-        tr_debug(" Checking application at slot %" PRIu32 "", slotIndex);
-        MbedApplication &newestApplication = newestSlotIndex == _nbrOfSlots ?
-                                             activeApplication : *_candidateApplicationArray[newestSlotIndex];
-
-        if (_candidateApplicationArray[slotIndex]->isNewerThan(newestApplication)) {
-#if MBED_CONF_MBED_TRACE_ENABLE
-            if (newestSlotIndex == _nbrOfSlots) {
-                tr_debug(" Candidate application at slot %" PRIu32 " is newer than the active one", slotIndex);
-            } else {
-                tr_debug(" Candidate application at slot %" PRIu32 " is newer than application at slot %" PRIu32 "",
-                         slotIndex, newestSlotIndex);
-            }
-#endif
-            int32_t result = _candidateApplicationArray[slotIndex]->checkApplication();
-            if (result != UC_ERR_NONE) {
-                tr_error(" Candidate application at slot %" PRIu32 " is not valid: %" PRIi32 "", slotIndex, result);
-                continue;
-            }
-            tr_debug(" Candidate application at slot %" PRIu32 " is valid", slotIndex);
+        if (! _slotMetadataIndex.isNewerThan(slotIndex, activeApplication)) {
+            continue;
+        }
+        tr_debug(" Candidate application at slot %" PRIu32 " is newer than the active one", slotIndex);
 
-            // update the newest slot index
-            newestSlotIndex = slotIndex;
+        // insert by decreasing version, slots with the same version keep their order
+        uint32_t rank = nbrOfRankedSlots;
+        while (rank > 0 && _slotMetadataIndex.isNewerThan(slotIndex, rankedSlotArray[rank - 1])) {
+            rankedSlotArray[rank] = rankedSlotArray[rank - 1];
+            rank--;
         }
+        rankedSlotArray[rank] = slotIndex;
+        nbrOfRankedSlots++;
     }
+
+    for (uint32_t rank = 0; rank < nbrOfRankedSlots; rank++) {
+        const uint32_t slotIndex = rankedSlotArray[rank];
+        tr_debug(" Checking application at slot %" PRIu32 " (version %" PRIu64 ")",
+                 slotIndex, _slotMetadataIndex.getFirmwareVersion(slotIndex));
+        int32_t result = getApplication(slotIndex).checkApplication();
+        if (result != UC_ERR_NONE) {
+            // fall back to the next candidate
+            tr_error(" Candidate application at slot %" PRIu32 " is not valid: %" PRIi32 "", slotIndex, result);
+            _slotMetadataIndex.setState(slotIndex, SlotMetadataIndex::SLOT_NOT_VALID);
+            continue;
+        }
+        tr_debug(" Candidate application at slot %" PRIu32 " is valid", slotIndex);
+        _slotMetadataIndex.setState(slotIndex, SlotMetadataIndex::SLOT_VALID);
+
+        newestSlotIndex = slotIndex;
+        break;
+    }
+
     return newestSlotIndex != _nbrOfSlots;
 }
 
+int32_t CandidateApplications::eraseSlot(uint32_t slotIndex)
+{
+    uint32_t candidateAddress = 0;
+    uint32_t slotSize = 0;
+    int32_t result = getCandidateAddress(slotIndex, candidateAddress, slotSize);
+    if (result != UC_ERR_NONE) {
+        return result;
+    }
+
+    // the application in the slot is about to be erased
+    if (_verificationCache != NULL) {
+        result = _verificationCache->invalidate(candidateAddress);
+        if (result != UC_ERR_NONE) {
+            tr_error("Cannot invalidate verification of slot %" PRIu32 ": %" PRIi32 "", slotIndex, result);
+            return result;
+        }
+    }
+    delete _candidateApplicationArray[slotIndex];
+    _candidateApplicationArray[slotIndex] = NULL;
+    _slotMetadataIndex.setState(slotIndex, SlotMetadataIndex::SLOT_NOT_VALID);
+
+    uint32_t nbrOfSectorsErased = 0;
+    result = _flashUpdater.eraseRange(candidateAddress, slotSize, nbrOfSectorsErased);
+    if (result != UC_ERR_NONE) {
+        tr_error("Cannot erase slot %" PRIu32 ": %" PRIi32 "", slotIndex, result);
+        return result;
+    }
+    tr_debug(" Slot %" PRIu32 " erased (%" PRIu32 " sectors)", slotIndex, nbrOfSectorsErased);
+
+    // the slot is blank now, an erase cycle is only counted if sectors were erased
+    if (_slotWearRecord != NULL) {
+        uint32_t eraseCount = 0;
+        bool isBlank = false;
+        _slotWearRecord->getSlotWear(candidateAddress, eraseCount, isBlank);
+        result = _slotWearRecord->setSlotWear(candidateAddress,
+                                              (nbrOfSectorsErased > 0) ? eraseCount + 1 : eraseCount, true);
+        if (result != UC_ERR_NONE) {
+            tr_error("Cannot record erase of slot %" PRIu32 ": %" PRIi32 "", slotIndex, result);
+            return result;
+        }
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t CandidateApplications::recordSlotWrite(uint32_t slotIndex)
+{
+    if (_slotWearRecord == NULL) {
+        return UC_ERR_NONE;
+    }
+    uint32_t candidateAddress = 0;
+    uint32_t slotSize = 0;
+    int32_t result = getCandidateAddress(slotIndex, candidateAddress, slotSize);
+    if (result != UC_ERR_NONE) {
+        return result;
+    }
+
+    // a slot that is not blank is erased while being written
+    uint32_t eraseCount = 0;
+    bool isBlank = false;
+    _slotWearRecord->getSlotWear(candidateAddress, eraseCount, isBlank);
+    return _slotWearRecord->setSlotWear(candidateAddress, isBlank ? eraseCount : eraseCount + 1, false);
+}
+
+void CandidateApplications::setSlotWearRecord(SlotWearRecord *slotWearRecord)
+{
+    _slotWearRecord = slotWearRecord;
+}
+
+void CandidateApplications::setDownloadProgress(DownloadProgress *downloadProgress)
+{
+    _downloadProgress = downloadProgress;
+}
+
+void CandidateApplications::setVerificationCache(VerificationCache *verificationCache)
+{
+    _verificationCache = verificationCache;
+    for (uint32_t slotIndex = 0; slotIndex < _nbrOfSlots; slotIndex++) {
+        if (_candidateApplicationArray[slotIndex] != NULL) {
+            _candidateApplicationArray[slotIndex]->setVerificationCache(verificationCache);
+        }
+    }
+}
+
+void CandidateApplications::setBootSlotRecord(BootSlotRecord *bootSlotRecord)
+{
+    _bootSlotRecord = bootSlotRecord;
+}
+
+bool CandidateApplications::getBootSlot(uint32_t &slotIndex)
+{
+    uint32_t headerAddress = 0;
+    uint32_t headerCrc = 0;
+    uint64_t firmwareVersion = 0;
+    if (_bootSlotRecord == NULL || ! _bootSlotRecord->getBootSlot(headerAddress, headerCrc, firmwareVersion)) {
+        return false;
+    }
+
+    // the record only holds if the slot still contains the activated application
+    for (slotIndex = 0; slotIndex < _nbrOfSlots; slotIndex++) {
+        uint32_t candidateAddress = 0;
+        uint32_t slotSize = 0;
+        if (getCandidateAddress(slotIndex, candidateAddress, slotSize) != UC_ERR_NONE ||
+                candidateAddress != headerAddress) {
+            continue;
+        }
+        const SlotMetadataIndex::SlotMetadata &slotMetadata = _slotMetadataIndex.getSlotMetadata(slotIndex);
+        return _slotMetadataIndex.isCandidate(slotIndex) &&
+               slotMetadata.headerCrc == headerCrc && slotMetadata.firmwareVersion == firmwareVersion;
+    }
+
+    return false;
+}
+
+bool CandidateApplications::canBootFromSlot(uint32_t slotIndex)
+{
+#if (MBED_CONF_UPDATE_CLIENT_POSITION_INDEPENDENT_IMAGES == 1)
+    (void) slotIndex;
+    return true;
+#else
+    uint32_t candidateAddress = 0;
+    uint32_t slotSize = 0;
+    if (getCandidateAddress(slotIndex, candidateAddress, slotSize) != UC_ERR_NONE) {
+        return false;
+    }
+
+    // an application linked at the slot address has its reset handler in the slot
+    // (the vector table starts with the initial stack pointer and the reset handler)
+    const uint32_t applicationAddress = candidateAddress + _headerSize;
+    uint32_t vectorTable[2] = { 0 };
+    int err = _flashUpdater.read(vectorTable, applicationAddress, sizeof(vectorTable));
+    if (err != 0) {
+        tr_error("Flash read failed: %d", err);
+        return false;
+    }
+    const uint32_t resetHandler = vectorTable[1] & ~1UL;
+    return resetHandler >= applicationAddress && resetHandler < candidateAddress + slotSize;
+#endif
+}
+
 #if defined(POST_APPLICATION_ADDR)
+int32_t CandidateApplications::activateApplication(uint32_t slotIndex, uint32_t destHeaderAddress,
+                                                   InstallMode installMode, bool &bootFromSlot,
+                                                   uint32_t &nbrOfSectorsWritten)
+{
+    nbrOfSectorsWritten = 0;
+    bootFromSlot = (_bootSlotRecord != NULL && canBootFromSlot(slotIndex));
+    if (bootFromSlot) {
+        uint32_t candidateAddress = 0;
+        uint32_t slotSize = 0;
+        int32_t result = getCandidateAddress(slotIndex, candidateAddress, slotSize);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        tr_debug(" Activating candidate application at slot %" PRIu32 " in place", slotIndex);
+        const SlotMetadataIndex::SlotMetadata &slotMetadata = _slotMetadataIndex.getSlotMetadata(slotIndex);
+        return _bootSlotRecord->setBootSlot(candidateAddress, slotMetadata.headerCrc, slotMetadata.firmwareVersion);
+    }
+
+    // the previous boot slot keeps being started until the copy is complete
+    int32_t result = installApplication(slotIndex, destHeaderAddress, installMode, nbrOfSectorsWritten);
+    if (result != UC_ERR_NONE) {
+        return result;
+    }
+    if (_bootSlotRecord != NULL) {
+        result = _bootSlotRecord->clear();
+    }
+
+    return result;
+}
+
 int32_t CandidateApplications::installApplication(uint32_t slotIndex, uint32_t destHeaderAddress)
+{
+    uint32_t nbrOfSectorsWritten = 0;
+    return installApplication(slotIndex, destHeaderAddress, INSTALL_ALL_SECTORS, nbrOfSectorsWritten);
+}
+
+int32_t CandidateApplications::installApplication(uint32_t slotIndex, uint32_t destHeaderAddress,
+                                                  InstallMode installMode, uint32_t &nbrOfSectorsWritten)
 {
     tr_debug(" Installing candidate application at slot %d as active application", slotIndex);
     const uint32_t pageSize = _flashUpdater.get_page_size();
     tr_debug("Flash page size is %d", pageSize);
 
-    std::unique_ptr<char> writePageBuffer = std::unique_ptr<char>(new char[pageSize]);
-    std::unique_ptr<char> readPageBuffer = std::unique_ptr<char>(new char[pageSize]);
+    PageBuffer writePageBuffer(pageSize);
+    PageBuffer readPageBuffer(pageSize);
+    FlashStreamWriter streamWriter(_flashUpdater);
 
     uint32_t destAddr = destHeaderAddress;
     uint32_t sourceAddr = 0;
@@ -194,45 +540,210 @@ int32_t CandidateApplications::installApplication(uint32_t slotIndex, uint32_t d
         return result;
     }
 
-    const uint32_t destSectorSize = _flashUpdater.get_sector_size(destAddr);
-    uint32_t nextDestSectorAddress = destAddr + destSectorSize;
-    bool destSectorErased = false;
-    size_t destPagesFlashed = 0;
+    // the active application is about to be rewritten
+    if (_verificationCache != NULL) {
+        result = _verificationCache->invalidate(destHeaderAddress);
+        if (result != UC_ERR_NONE) {
+            tr_error("Cannot invalidate verification of application at address 0x%08x", destHeaderAddress);
+            return result;
+        }
+    }
 
-    // add the header size to the firmware size
+    // add the header size to the firmware size and copy whole pages
     const uint32_t headerSize = POST_APPLICATION_ADDR - HEADER_ADDR;
     tr_debug(" Header size is %d", headerSize);
-    const uint64_t copySize = _candidateApplicationArray[slotIndex]->getFirmwareSize() + headerSize;
+    const uint64_t imageSize = _slotMetadataIndex.getFirmwareSize(slotIndex) + headerSize;
+    const uint64_t copySize = ((imageSize + pageSize - 1) / pageSize) * pageSize;
 
     uint32_t nbrOfBytes = 0;
+    nbrOfSectorsWritten = 0;
+
+    // the sector holding the header is copied last, with the header pages programmed at the very
+    // end, so that an interrupted installation leaves no valid header. Bytes are counted in copy
+    // order: the sectors after the header sector first, then the header sector
+    const uint32_t headerSectorSize = (copySize < _flashUpdater.getSectorSize(destHeaderAddress)) ?
+                                      (uint32_t) copySize : _flashUpdater.getSectorSize(destHeaderAddress);
+    const uint32_t headerPagesSize = ((headerSize + pageSize - 1) / pageSize) * pageSize;
+    const uint32_t deferredSize = (headerPagesSize < headerSectorSize) ? headerPagesSize : 0;
+
+    // an interrupted installation of the same candidate resumes after the last completed sector
+    const uint32_t headerCrc = _slotMetadataIndex.getSlotMetadata(slotIndex).headerCrc;
+    const uint32_t candidateAddr = sourceAddr;
+    if (_installJournal != NULL) {
+        nbrOfBytes = _installJournal->getResumeOffset(destHeaderAddress, candidateAddr, headerCrc, (uint32_t) copySize);
+        if (nbrOfBytes > 0) {
+            tr_debug(" Resuming installation after %" PRIu32 " bytes", nbrOfBytes);
+        }
+    }
+    // the header sector was erased before any other sector was written
+    bool headerErased = (nbrOfBytes > 0);
+    // without a full verification of programmed pages, sectors are compared before being journaled
+    const bool verifySectors = (_flashUpdater.getVerifyMode() != FlashUpdater::VERIFY_READ_BACK &&
+                                _flashUpdater.getVerifyMode() != FlashUpdater::VERIFY_CRC);
     tr_debug(" Starting to copy application from address 0x%08x to address 0x%08x", sourceAddr, destAddr);
 
+    // copy the application one destination sector at a time
     while (nbrOfBytes < copySize) {
-        // read the page from the candidate application
-        result = _flashUpdater.readPage(pageSize, writePageBuffer.get(), sourceAddr);
-        if (result != UC_ERR_NONE) {
-            tr_error("Cannot read candidate application at slot %d (address 0x%08x)", slotIndex, sourceAddr);
-            return result;
+        const uint32_t copyOffset = (nbrOfBytes < copySize - headerSectorSize) ?
+                                    (headerSectorSize + nbrOfBytes) : (nbrOfBytes - (uint32_t)(copySize - headerSectorSize));
+        const bool isHeaderSector = (copyOffset == 0);
+        sourceAddr = candidateAddr + copyOffset;
+        destAddr = destHeaderAddress + copyOffset;
+        const uint32_t destSectorSize = _flashUpdater.getSectorSize(destAddr);
+        const uint32_t sectorCopySize = (copySize - copyOffset < destSectorSize) ?
+                                        (uint32_t)(copySize - copyOffset) : destSectorSize;
+
+        // sectors that already hold the candidate content are left untouched
+        if (installMode == INSTALL_CHANGED_SECTORS) {
+            bool isIdentical = false;
+            result = compareSector(sourceAddr, destAddr, sectorCopySize,
+                                   writePageBuffer.get(), readPageBuffer.get(), isIdentical);
+            if (result != UC_ERR_NONE) {
+                tr_error("Cannot compare candidate application at slot %d (address 0x%08x)", slotIndex, sourceAddr);
+                return result;
+            }
+            if (isIdentical) {
+                nbrOfBytes += sectorCopySize;
+                continue;
+            }
         }
 
-        // write the page to the flash active application address
-        // destAddr and beyond are modified in the writePage method
-        result = _flashUpdater.writePage(pageSize, writePageBuffer.get(), readPageBuffer.get(),
-                                        destAddr, destSectorErased, destPagesFlashed, nextDestSectorAddress);
+        // the header of the active application is invalidated before its content is modified
+        if (! isHeaderSector && ! headerErased) {
+            uint32_t nbrOfSectorsErased = 0;
+            result = _flashUpdater.eraseRange(destHeaderAddress, headerSectorSize, nbrOfSectorsErased);
+            if (result != UC_ERR_NONE) {
+                tr_error("Cannot erase header of active application at address 0x%08x", destHeaderAddress);
+                return result;
+            }
+            headerErased = true;
+        }
+
+        // the sector is erased unless blank and programmed with as few calls as possible
+        result = streamWriter.start(destAddr, isHeaderSector ? deferredSize : 0);
         if (result != UC_ERR_NONE) {
             tr_error("Cannot write candidate application at slot %d (address 0x%08x)", slotIndex, destAddr);
             return result;
         }
-        
+        const char *pSource = reinterpret_cast<const char *>(_flashUpdater.getFlashSpan(sourceAddr, sectorCopySize));
+        if (pSource != NULL) {
+            // program the sector directly from the candidate application
+            result = streamWriter.append(pSource, sectorCopySize);
+            sourceAddr += sectorCopySize;
+        } else {
+            for (uint32_t sectorOffset = 0; sectorOffset < sectorCopySize && result == UC_ERR_NONE; sectorOffset += pageSize) {
+                // read the page from the candidate application
+                result = _flashUpdater.readPage(pageSize, writePageBuffer.get(), sourceAddr);
+                if (result != UC_ERR_NONE) {
+                    tr_error("Cannot read candidate application at slot %d (address 0x%08x)", slotIndex, sourceAddr);
+                    return result;
+                }
+                result = streamWriter.append(writePageBuffer.get(), pageSize);
+            }
+        }
+        if (result == UC_ERR_NONE && isHeaderSector) {
+            // the header pages are programmed once the rest of the application is in place
+            result = streamWriter.commitDeferredData();
+        }
+        if (result != UC_ERR_NONE) {
+            tr_error("Cannot write candidate application at slot %d (address 0x%08x)", slotIndex, streamWriter.getAddress());
+            return result;
+        }
+
+        // the sector is complete, record it in the journal
+        if (_installJournal != NULL) {
+            if (verifySectors) {
+                bool isIdentical = false;
+                result = compareSector(sourceAddr - sectorCopySize, destAddr, sectorCopySize,
+                                       writePageBuffer.get(), readPageBuffer.get(), isIdentical);
+                if (result == UC_ERR_NONE && ! isIdentical) {
+                    result = UC_ERR_WRITE_FAILED;
+                }
+                if (result != UC_ERR_NONE) {
+                    tr_error("Cannot verify active application at address 0x%08x", destAddr);
+                    return result;
+                }
+            }
+            result = _installJournal->setCompletedSize(destHeaderAddress, candidateAddr, headerCrc,
+                                                       (uint32_t) copySize, nbrOfBytes + sectorCopySize);
+            if (result != UC_ERR_NONE) {
+                tr_error("Cannot record installation progress: %" PRIi32 "", result);
+                return result;
+            }
+        }
+        nbrOfSectorsWritten++;
+
         // update progress
-        nbrOfBytes += pageSize;
+        nbrOfBytes += sectorCopySize;
 #if MBED_CONF_MBED_TRACE_ENABLE
         // tr_debug("Copied %05d bytes", nbrOfBytes);
 #endif
     }
-    tr_debug(" Copied %d bytes", nbrOfBytes);
-    writePageBuffer = NULL;
-    readPageBuffer = NULL;
+    tr_debug(" Copied %d bytes (%d sectors written)", nbrOfBytes, nbrOfSectorsWritten);
+
+    if (_installJournal != NULL) {
+        result = _installJournal->clear(destHeaderAddress);
+        if (result != UC_ERR_NONE) {
+            tr_error("Cannot clear installation progress: %" PRIi32 "", result);
+            return result;
+        }
+    }
+
+    return UC_ERR_NONE;
+}
+
+void CandidateApplications::setInstallJournal(InstallJournal *installJournal)
+{
+    _installJournal = installJournal;
+}
+
+bool CandidateApplications::hasInterruptedInstallation(uint32_t destHeaderAddress, uint32_t &slotIndex)
+{
+    // a single lookup in the journal, the slots are not read
+    uint32_t sourceAddress = 0;
+    if (_installJournal == NULL || ! _installJournal->isInProgress(destHeaderAddress, sourceAddress)) {
+        return false;
+    }
+    for (slotIndex = 0; slotIndex < _nbrOfSlots; slotIndex++) {
+        uint32_t candidateAddress = 0;
+        uint32_t slotSize = 0;
+        if (getCandidateAddress(slotIndex, candidateAddress, slotSize) == UC_ERR_NONE &&
+                candidateAddress == sourceAddress) {
+            tr_debug(" Installation of slot %" PRIu32 " was interrupted", slotIndex);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int32_t CandidateApplications::compareSector(uint32_t sourceAddr, uint32_t destAddr, uint32_t size,
+                                             char *sourcePageBuffer, char *destPageBuffer, bool &isIdentical)
+{
+    isIdentical = true;
+    const uint8_t *pSource = _flashUpdater.getFlashSpan(sourceAddr, size);
+    const uint8_t *pDest = _flashUpdater.getFlashSpan(destAddr, size);
+    if (pSource != NULL && pDest != NULL) {
+        // compare in place
+        isIdentical = (memcmp(pSource, pDest, size) == 0);
+        return UC_ERR_NONE;
+    }
+
+    const uint32_t pageSize = _flashUpdater.get_page_size();
+    for (uint32_t offset = 0; offset < size; offset += pageSize) {
+        int32_t result = _flashUpdater.readPage(pageSize, sourcePageBuffer, sourceAddr);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        result = _flashUpdater.readPage(pageSize, destPageBuffer, destAddr);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        if (memcmp(sourcePageBuffer, destPageBuffer, pageSize) != 0) {
+            isIdentical = false;
+            break;
+        }
+    }
 
     return UC_ERR_NONE;
 }
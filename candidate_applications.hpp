@@ -2,8 +2,15 @@
 
 #include "mbed.h"
 
+#include "boot_slot_record.hpp"
+#include "download_progress.hpp"
 #include "mbed_application.hpp"
+#include "flash_geometry.hpp"
 #include "flash_updater.hpp"
+#include "install_journal.hpp"
+#include "slot_metadata_index.hpp"
+#include "slot_wear_record.hpp"
+#include "verification_cache.hpp"
 
 namespace update_client {
 
@@ -13,28 +20,93 @@ public:
                           uint32_t headerSize, uint32_t nbrOfSlots);
     virtual ~CandidateApplications();
 
+    // instances are allocated from the update client arena
+    static void *operator new(size_t size);
+    static void operator delete(void *pMemory);
+
     // methods that can be overriden 
+    // the default policy only uses the slot metadata: it resumes a partial download, then
+    // prefers blank slots, slots without a valid header and older applications, each with the
+    // fewest erase cycles. The newest application and the boot slot are chosen last
     virtual uint32_t getSlotForCandidate();
 
     // public methods
     uint32_t getNbrOfSlots() const;
     MbedApplication &getMbedApplication(uint32_t slotIndex);
+    // queries answered from the slot metadata index, without accessing the flash
+    uint64_t getFirmwareVersion(uint32_t slotIndex) const;
+    uint64_t getFirmwareSize(uint32_t slotIndex) const;
+    bool isNewerThan(uint32_t slotIndex, MbedApplication &otherApplication) const;
+    bool getNewestSlot(uint32_t &newestSlotIndex) const;
     int32_t getCandidateAddress(uint32_t slotIndex, uint32_t &applicationAddress, uint32_t &slotSize) const;
     void logCandidateAddress(uint32_t slotIndex) const;
     bool hasValidNewerApplication(MbedApplication &activeApplication, uint32_t &newestSlotIndex) const;
+    // erase a slot ahead of a download, sectors that are already erased are skipped
+    int32_t eraseSlot(uint32_t slotIndex);
+    // use a cache of verified applications for all slots
+    void setVerificationCache(VerificationCache *verificationCache);
+    // record activations in place, so that the bootloader starts applications from their slot
+    void setBootSlotRecord(BootSlotRecord *bootSlotRecord);
+    // returns true if the application is started from a slot, which must not be rewritten
+    bool getBootSlot(uint32_t &slotIndex);
+    // returns true if the application in the slot can run without being copied, that is if
+    // it is position independent or linked at the slot address
+    bool canBootFromSlot(uint32_t slotIndex);
+    // count erase cycles and blank slots, for spreading the wear over the slots
+    void setSlotWearRecord(SlotWearRecord *slotWearRecord);
+    // partially downloaded images are kept for resuming their transfer
+    void setDownloadProgress(DownloadProgress *downloadProgress);
+    // must be called before a download rewrites a slot, which erases it unless it is blank
+    int32_t recordSlotWrite(uint32_t slotIndex);
     // the installApplication method is used by the bootloader application
     // (for which the POST_APPLICATION_ADDR symbol is defined)
 #if defined(POST_APPLICATION_ADDR)
+    enum InstallMode {
+        // erase and program every destination sector
+        INSTALL_ALL_SECTORS,
+        // only erase and program destination sectors that differ from the candidate
+        INSTALL_CHANGED_SECTORS
+    };
     int32_t installApplication(uint32_t slotIndex, uint32_t destHeaderAddress);
+    int32_t installApplication(uint32_t slotIndex, uint32_t destHeaderAddress,
+                               InstallMode installMode, uint32_t &nbrOfSectorsWritten);
+    // activate a candidate by recording its slot as boot slot (a single record write) if it can
+    // run from there and by installing it otherwise
+    int32_t activateApplication(uint32_t slotIndex, uint32_t destHeaderAddress, InstallMode installMode,
+                                bool &bootFromSlot, uint32_t &nbrOfSectorsWritten);
+    // record the progress of installations, so that an interrupted one resumes where it stopped
+    void setInstallJournal(InstallJournal *installJournal);
+    // returns true if the installation of a candidate to the destination was interrupted
+    bool hasInterruptedInstallation(uint32_t destHeaderAddress, uint32_t &slotIndex);
 #endif
 
 private:
+    // private methods
+    MbedApplication &getApplication(uint32_t slotIndex) const;
+    // lower ranks are chosen first by getSlotForCandidate
+    uint32_t getSlotRank(uint32_t slotIndex, uint32_t bootSlotIndex, uint32_t newestSlotIndex,
+                         uint32_t &eraseCount);
+#if defined(POST_APPLICATION_ADDR)
+    int32_t compareSector(uint32_t sourceAddr, uint32_t destAddr, uint32_t size,
+                          char *sourcePageBuffer, char *destPageBuffer, bool &isIdentical);
+#endif
+
     // data members
     FlashUpdater &_flashUpdater;
     uint32_t _storageAddress;
     uint32_t _storageSize;
+    uint32_t _headerSize;
     uint32_t _nbrOfSlots;
-    MbedApplication *_candidateApplicationArray[MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS];
+    bool _useBoardGeometry;
+    VerificationCache *_verificationCache;
+    InstallJournal *_installJournal;
+    BootSlotRecord *_bootSlotRecord;
+    SlotWearRecord *_slotWearRecord;
+    DownloadProgress *_downloadProgress;
+    // the index and the applications cache the result of checks
+    mutable SlotMetadataIndex _slotMetadataIndex;
+    // applications are only created when they need to be hashed or are requested
+    mutable MbedApplication *_candidateApplicationArray[MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS];
 };
                                                             
 } // namespace update_client
@@ -0,0 +1,144 @@
+#include "delta_patcher.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "DeltaPatcher"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+DeltaPatcher::DeltaPatcher(FlashUpdater &flashUpdater, uint32_t sourceAddress, uint32_t sourceSize,
+                           const uint8_t *pSourceHash) :
+    _flashUpdater(flashUpdater),
+    _sourceAddress(sourceAddress),
+    _sourceSize(sourceSize),
+    _state(STATE_HEADER),
+    _result(UC_ERR_NONE),
+    _fieldSize(0),
+    _copyOffset(0),
+    _remainingSize(0)
+{
+    memcpy(_sourceHash, pSourceHash, sizeof(_sourceHash));
+    memset(_field, 0, sizeof(_field));
+}
+
+void DeltaPatcher::reset()
+{
+    _state = STATE_HEADER;
+    _result = UC_ERR_NONE;
+    _fieldSize = 0;
+    _copyOffset = 0;
+    _remainingSize = 0;
+}
+
+int32_t DeltaPatcher::apply(const uint8_t *pInput, uint32_t inputSize, uint32_t &nbrOfBytesConsumed,
+                            uint8_t *pOutput, uint32_t outputSize, uint32_t &nbrOfBytesProduced)
+{
+    uint32_t inputIndex = 0;
+    uint32_t outputIndex = 0;
+    while (_state != STATE_ERROR) {
+        if (_state == STATE_HEADER || _state == STATE_COMMAND) {
+            const uint32_t fieldSize = (_state == STATE_HEADER) ? kHeaderSize : kCommandSize;
+            while (_fieldSize < fieldSize && inputIndex < inputSize) {
+                _field[_fieldSize++] = pInput[inputIndex++];
+            }
+            if (_fieldSize < fieldSize) {
+                break;
+            }
+            _fieldSize = 0;
+            _result = (_state == STATE_HEADER) ? parseHeader() : parseCommand();
+            if (_result != UC_ERR_NONE) {
+                _state = STATE_ERROR;
+            }
+        } else if (_state == STATE_COPY) {
+            const uint32_t copySize = (_remainingSize < outputSize - outputIndex) ? _remainingSize : (outputSize - outputIndex);
+            if (copySize == 0) {
+                break;
+            }
+            int err = _flashUpdater.read(&pOutput[outputIndex], _sourceAddress + _copyOffset, copySize);
+            if (err != 0) {
+                tr_error("Flash read failed: %d", err);
+                _result = UC_ERR_READING_FLASH;
+                _state = STATE_ERROR;
+                break;
+            }
+            outputIndex += copySize;
+            _copyOffset += copySize;
+            _remainingSize -= copySize;
+            if (_remainingSize == 0) {
+                _state = STATE_COMMAND;
+            }
+        } else {
+            uint32_t copySize = (_remainingSize < outputSize - outputIndex) ? _remainingSize : (outputSize - outputIndex);
+            copySize = (copySize < inputSize - inputIndex) ? copySize : (inputSize - inputIndex);
+            if (copySize == 0) {
+                break;
+            }
+            memcpy(&pOutput[outputIndex], &pInput[inputIndex], copySize);
+            outputIndex += copySize;
+            inputIndex += copySize;
+            _remainingSize -= copySize;
+            if (_remainingSize == 0) {
+                _state = STATE_COMMAND;
+            }
+        }
+    }
+
+    nbrOfBytesConsumed = inputIndex;
+    nbrOfBytesProduced = outputIndex;
+    return _result;
+}
+
+bool DeltaPatcher::needsInput() const
+{
+    // a copy only needs output space
+    return _state != STATE_COPY;
+}
+
+int32_t DeltaPatcher::parseHeader()
+{
+    if (parseUint32(_field) != kMagic) {
+        tr_error("Invalid patch magic 0x%08" PRIx32 "", parseUint32(_field));
+        return UC_ERR_INVALID_PATCH;
+    }
+    if (memcmp(&_field[4], _sourceHash, sizeof(_sourceHash)) != 0) {
+        tr_error("Patch does not apply to the active application");
+        return UC_ERR_INVALID_PATCH;
+    }
+    _state = STATE_COMMAND;
+
+    return UC_ERR_NONE;
+}
+
+int32_t DeltaPatcher::parseCommand()
+{
+    const uint32_t firstField = parseUint32(&_field[1]);
+    const uint32_t secondField = parseUint32(&_field[5]);
+    if (_field[0] == COMMAND_COPY) {
+        // copies must stay within the active image
+        if (firstField > _sourceSize || secondField > _sourceSize - firstField) {
+            tr_error("Invalid copy of %" PRIu32 " bytes from offset %" PRIu32 "", secondField, firstField);
+            return UC_ERR_INVALID_PATCH;
+        }
+        _copyOffset = firstField;
+        _remainingSize = secondField;
+        _state = (secondField > 0) ? STATE_COPY : STATE_COMMAND;
+    } else if (_field[0] == COMMAND_INSERT) {
+        _remainingSize = firstField;
+        _state = (firstField > 0) ? STATE_INSERT : STATE_COMMAND;
+    } else {
+        tr_error("Invalid patch command %d", _field[0]);
+        return UC_ERR_INVALID_PATCH;
+    }
+
+    return UC_ERR_NONE;
+}
+
+uint32_t DeltaPatcher::parseUint32(const uint8_t *pBuffer)
+{
+    return (uint32_t) pBuffer[0] | ((uint32_t) pBuffer[1] << 8) |
+           ((uint32_t) pBuffer[2] << 16) | ((uint32_t) pBuffer[3] << 24);
+}
+
+} // namespace update_client
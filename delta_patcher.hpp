@@ -0,0 +1,70 @@
+#pragma once
+
+#include "mbed.h"
+
+#include "flash_updater.hpp"
+#include "mbed_application.hpp"
+
+namespace update_client {
+
+// DeltaPatcher rebuilds an image from a patch against the active application
+// The patch starts with the magic "UCDP" and the hash of the active application it applies to,
+// followed by commands made of a tag and two 32 bit little endian fields:
+//   COPY   (source offset, length): copy length bytes of the active image from the offset
+//   INSERT (length, 0): copy the length bytes that follow the command
+// Offsets are relative to the header of the active application, so that unchanged parts of
+// the header can be copied as well. Input and output can be split at any byte boundary
+
+class DeltaPatcher {
+public:
+    enum CommandTag {
+        COMMAND_COPY = 1,
+        COMMAND_INSERT = 2
+    };
+
+    // constructor, the source is the active image (header and application)
+    DeltaPatcher(FlashUpdater &flashUpdater, uint32_t sourceAddress, uint32_t sourceSize,
+                 const uint8_t *pSourceHash);
+
+    // restart the patcher for a new patch
+    void reset();
+    // apply the patch until the input is consumed or the output is full
+    // returns the number of input bytes consumed and output bytes produced
+    int32_t apply(const uint8_t *pInput, uint32_t inputSize, uint32_t &nbrOfBytesConsumed,
+                  uint8_t *pOutput, uint32_t outputSize, uint32_t &nbrOfBytesProduced);
+    // returns true if patching is waiting for input (all patched bytes have been produced)
+    bool needsInput() const;
+
+    static constexpr uint32_t kMagic = 0x50444355;
+    static constexpr uint32_t kHeaderSize = 4 + MbedApplication::kHashSize;
+    static constexpr uint32_t kCommandSize = 9;
+
+private:
+    enum State {
+        STATE_HEADER,
+        STATE_COMMAND,
+        STATE_COPY,
+        STATE_INSERT,
+        STATE_ERROR
+    };
+
+    int32_t parseHeader();
+    int32_t parseCommand();
+    static uint32_t parseUint32(const uint8_t *pBuffer);
+
+    // data members
+    FlashUpdater &_flashUpdater;
+    const uint32_t _sourceAddress;
+    const uint32_t _sourceSize;
+    uint8_t _sourceHash[MbedApplication::kHashSize];
+    State _state;
+    int32_t _result;
+    // header or command being received
+    uint8_t _field[kHeaderSize];
+    uint32_t _fieldSize;
+    // current command
+    uint32_t _copyOffset;
+    uint32_t _remainingSize;
+};
+
+} // namespace update_client
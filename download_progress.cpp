@@ -0,0 +1,55 @@
+#include "download_progress.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "DownloadProgress"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+DownloadProgress::DownloadProgress(FlashRecordLog &recordLog) :
+    _recordLog(recordLog)
+{
+
+}
+
+uint32_t DownloadProgress::getResumeOffset(uint32_t headerAddress, uint32_t imageId, uint32_t imageSize)
+{
+    FlashRecordLog::Record record;
+    if (_recordLog.find(kProgressRecordType, headerAddress, record) != UC_ERR_NONE) {
+        return 0;
+    }
+    if (record.values[0] != imageId || record.values[1] != imageSize) {
+        // the slot holds part of another image
+        return 0;
+    }
+
+    return record.values[2];
+}
+
+bool DownloadProgress::isInProgress(uint32_t headerAddress)
+{
+    FlashRecordLog::Record record;
+    return _recordLog.find(kProgressRecordType, headerAddress, record) == UC_ERR_NONE;
+}
+
+int32_t DownloadProgress::setProgrammedSize(uint32_t headerAddress, uint32_t imageId, uint32_t imageSize,
+                                            uint32_t programmedSize)
+{
+    tr_debug(" Image 0x%08" PRIx32 ": %" PRIu32 " of %" PRIu32 " bytes programmed", imageId, programmedSize, imageSize);
+    const uint32_t values[FlashRecordLog::kNbrOfValues] = {
+        imageId,
+        imageSize,
+        programmedSize,
+        0
+    };
+    return _recordLog.write(kProgressRecordType, headerAddress, values);
+}
+
+int32_t DownloadProgress::clear(uint32_t headerAddress)
+{
+    return _recordLog.remove(kProgressRecordType, headerAddress);
+}
+
+} // namespace update_client
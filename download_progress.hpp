@@ -0,0 +1,33 @@
+#pragma once
+
+#include "flash_record_log.hpp"
+
+namespace update_client {
+
+// DownloadProgress records how much of an image has been durably programmed in a slot, so
+// that an interrupted transfer can be resumed from there instead of from the first byte
+// Entries are keyed on the header address of the slot and identify the image by an id
+// chosen by the host and by its size. The offset is always sector aligned
+
+class DownloadProgress {
+public:
+    // constructor
+    explicit DownloadProgress(FlashRecordLog &recordLog);
+
+    // returns the resume offset of the image, 0 if the slot holds no part of this image
+    uint32_t getResumeOffset(uint32_t headerAddress, uint32_t imageId, uint32_t imageSize);
+    // returns true if the slot holds a partially received image
+    bool isInProgress(uint32_t headerAddress);
+    int32_t setProgrammedSize(uint32_t headerAddress, uint32_t imageId, uint32_t imageSize, uint32_t programmedSize);
+    // must be called once the image is complete or when the slot is reused for another image
+    int32_t clear(uint32_t headerAddress);
+
+private:
+    // data members
+    FlashRecordLog &_recordLog;
+
+    // record types are unique among the users of the log
+    static constexpr uint16_t kProgressRecordType = 2;
+};
+
+} // namespace update_client
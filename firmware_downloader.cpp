@@ -0,0 +1,738 @@
+#include "firmware_downloader.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "FirmwareDownloader"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+#include "application_digest.hpp"
+#include "boot_slot_record.hpp"
+#include "candidate_applications.hpp"
+#include "delta_patcher.hpp"
+#include "download_progress.hpp"
+#include "flash_record_log.hpp"
+#include "flash_updater.hpp"
+#include "flash_writer_pipeline.hpp"
+#include "frame_protocol.hpp"
+#include "heatshrink_decoder.hpp"
+#include "slot_wear_record.hpp"
+#include "uc_arena.hpp"
+#include "uc_error_codes.hpp"
+#include "verification_cache.hpp"
+
+namespace update_client {
+
+#if (USE_USB_SERIAL_UC == 1) || (USE_BUFFERED_SERIAL_UC == 1) || (USE_SOCKET_TRANSPORT_UC == 1)
+
+FirmwareDownloader::FirmwareDownloader(Transport &transport) :
+    _transport(transport),
+    _downloaderThread(osPriorityNormal, OS_STACK_SIZE, nullptr, "DownloaderThread"),
+    _integrityScrubber(NULL),
+    _candidateSlotErased(false),
+    _pendingSlotWrite(NULL),
+    _pendingSlotIndex(0)
+{
+
+}
+
+void FirmwareDownloader::start()
+{
+    _downloaderThread.start(callback(this, &FirmwareDownloader::run));
+}
+
+void FirmwareDownloader::stop()
+{
+    // wakes up the downloader whether it waits for a connection or for data
+    _transport.cancel();
+    _downloaderThread.join();
+}
+
+void FirmwareDownloader::run()
+{
+    int32_t result = _transport.open();
+    if (result != UC_ERR_NONE) {
+        tr_error("Cannot open transport: %" PRIi32 "", result);
+        return;
+    }
+
+    while (true) {
+        // prepare the slot while the host connects, so that the transfer never waits for an erase
+        if (MBED_CONF_UPDATE_CLIENT_PRE_ERASE_CANDIDATE_SLOT && ! kDirectToActive && ! _candidateSlotErased) {
+            if (_integrityScrubber != NULL) {
+                _integrityScrubber->pause();
+            }
+            _candidateSlotErased = preEraseCandidateSlot();
+            if (_integrityScrubber != NULL) {
+                _integrityScrubber->resume();
+            }
+        }
+
+        // wait until the host connects or the thread is stopped
+        tr_debug("Waiting for connection");
+        result = _transport.waitForConnection(Transport::kWaitForever);
+        if (result == UC_ERR_CANCELLED) {
+            // exit the loop and the thread
+            tr_debug("Exiting downloadFirmware");
+            break;
+        }
+        if (result != UC_ERR_NONE) {
+            continue;
+        }
+
+        tr_debug("Updater connected");
+        if (_integrityScrubber != NULL) {
+            _integrityScrubber->pause();
+        }
+        result = downloadFirmware();
+        if (_integrityScrubber != NULL) {
+            _integrityScrubber->resume();
+        }
+        if (result == UC_ERR_CANCELLED) {
+            tr_debug("Exiting downloadFirmware");
+            break;
+        }
+    }
+
+    _transport.close();
+}
+
+void FirmwareDownloader::setIntegrityScrubber(IntegrityScrubber *integrityScrubber)
+{
+    _integrityScrubber = integrityScrubber;
+}
+
+int32_t FirmwareDownloader::downloadFirmware()
+{
+    // all buffers and objects of the session are allocated from the arena
+    // and released when the session ends
+    UpdateClientArena::Session arenaSession;
+
+    // initialize internal Flash
+    FlashUpdater flashUpdater;
+    int err = flashUpdater.init();
+    if (0 != err) {
+        tr_error("Init flash failed: %d", err);
+        return UC_ERR_INVALID_PARAMETER;
+    }
+
+    // recompute the header size (accounting for alignment)
+    const uint32_t headerSize = APPLICATION_ADDR - HEADER_ADDR;
+    tr_debug(" Application header size is %" PRIu32 "", headerSize);
+
+    // create the CandidateApplications instance for receiving the update
+    std::unique_ptr<CandidateApplications> candidateApplications = std::unique_ptr<CandidateApplications>(
+        createCandidateApplications(flashUpdater,
+                                    MBED_CONF_UPDATE_CLIENT_STORAGE_ADDRESS,
+                                    MBED_CONF_UPDATE_CLIENT_STORAGE_SIZE,
+                                    headerSize,
+                                    MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS));
+
+    // use the verification cache if a metadata area is configured
+    FlashRecordLog recordLog(flashUpdater,
+                             MBED_CONF_UPDATE_CLIENT_METADATA_ADDRESS,
+                             MBED_CONF_UPDATE_CLIENT_METADATA_SIZE);
+    VerificationCache verificationCache(recordLog);
+    VerificationCache *pVerificationCache = NULL;
+    // the slot the application is started from is never chosen for the candidate, the other
+    // slots are chosen for resuming transfers, avoiding erases and spreading the wear
+    BootSlotRecord bootSlotRecord(recordLog);
+    SlotWearRecord slotWearRecord(recordLog);
+    // an interrupted transfer is resumed if a metadata area is configured
+    DownloadProgress downloadProgress(recordLog);
+    if (MBED_CONF_UPDATE_CLIENT_METADATA_SIZE > 0) {
+        int32_t result = recordLog.init();
+        if (result == UC_ERR_NONE) {
+            pVerificationCache = &verificationCache;
+            candidateApplications.get()->setVerificationCache(pVerificationCache);
+            candidateApplications.get()->setBootSlotRecord(&bootSlotRecord);
+            candidateApplications.get()->setSlotWearRecord(&slotWearRecord);
+            candidateApplications.get()->setDownloadProgress(&downloadProgress);
+        } else {
+            tr_error("Cannot initialize metadata area: %" PRIi32 "", result);
+        }
+    }
+
+    uint32_t slotIndex = 0;
+    uint32_t candidateApplicationAddress = 0;
+    uint32_t slotSize = 0;
+    int32_t result = UC_ERR_NONE;
+    if (kDirectToActive) {
+        // the bootloader writes the image over the active application, its header is written
+        // last so that the application is not started unless the image is complete and valid
+        candidateApplicationAddress = HEADER_ADDR;
+        slotSize = getActiveRegionSize(flashUpdater);
+        tr_debug("Writing to the active application at address 0x%08" PRIx32 " (%" PRIu32 " bytes)",
+                 candidateApplicationAddress, slotSize);
+    } else {
+        // get the slot index to be used for storing the candidate application
+        tr_debug("Getting slot index...");
+        slotIndex = candidateApplications.get()->getSlotForCandidate();
+
+        tr_debug("Reading application info for slot %" PRIu32 "", slotIndex);
+        candidateApplications.get()->getMbedApplication(slotIndex).logApplicationInfo();
+
+        result = candidateApplications.get()->getCandidateAddress(slotIndex,
+                                                                  candidateApplicationAddress,
+                                                                  slotSize);
+        if (result != UC_ERR_NONE) {
+            tr_error("getCandidateAddress failed: %" PRIi32 "", result);
+            return result;
+        }
+        uint32_t addr = candidateApplicationAddress;
+        uint32_t sectorSize = flashUpdater.getSectorSize(addr);
+        tr_debug("Using slot %" PRIu32 " and starting to write at address 0x%08" PRIx32 " with sector size %" PRIu32 " (aligned %" PRIu32 ")",
+                 slotIndex, addr, sectorSize, addr % sectorSize);
+
+        // the erase of the slot is counted once it is written, unless the transfer of a
+        // partial image is resumed
+        if (! recordLog.isInitialized() || ! downloadProgress.isInProgress(candidateApplicationAddress)) {
+            _pendingSlotWrite = candidateApplications.get();
+            _pendingSlotIndex = slotIndex;
+        }
+    }
+
+    // the slot is about to be rewritten
+    if (pVerificationCache != NULL) {
+        result = pVerificationCache->invalidate(candidateApplicationAddress);
+        if (result != UC_ERR_NONE) {
+            tr_error("Cannot invalidate verification of slot %" PRIu32 ": %" PRIi32 "", slotIndex, result);
+            _pendingSlotWrite = NULL;
+            return result;
+        }
+    }
+
+    // pages are verified as configured, a deferred verification is done on the whole image below
+    flashUpdater.setVerifyMode((FlashUpdater::VerifyMode) MBED_CONF_UPDATE_CLIENT_PROGRAM_VERIFY_MODE);
+    flashUpdater.resetVerifyStats();
+
+    // the digest of the candidate is computed while pages are written
+    ApplicationDigest digest(headerSize);
+
+    // pages are programmed by the flash writer thread while the next ones are received
+    FlashWriterPipeline pipeline(flashUpdater, digest);
+    // compressed images are decompressed before reaching the pipeline, so that the digest
+    // and the flash hold the decompressed image
+    HeatshrinkDecoder decoder(MBED_CONF_UPDATE_CLIENT_DECOMPRESSION_WINDOW_BITS,
+                              MBED_CONF_UPDATE_CLIENT_DECOMPRESSION_LOOKAHEAD_BITS);
+    // the header of the active application identifies the base of patches
+    uint8_t activeHeaderBuffer[MbedApplication::kHeaderSizeV2] = { 0 };
+    MbedApplication::HeaderFields activeHeaderFields;
+    memset(&activeHeaderFields, 0, sizeof(activeHeaderFields));
+    bool activeHeaderValid = false;
+    if (flashUpdater.read(activeHeaderBuffer, HEADER_ADDR, sizeof(activeHeaderBuffer)) == 0) {
+        activeHeaderValid = MbedApplication::parseHeader(activeHeaderBuffer, activeHeaderFields) == UC_ERR_NONE;
+    }
+    DeltaPatcher patcher(flashUpdater, HEADER_ADDR, headerSize + (uint32_t) activeHeaderFields.firmwareSize,
+                         activeHeaderFields.hash);
+    // patches are applied against the active application if it has a valid header, except in
+    // direct-to-active mode where it is being overwritten
+    DeltaPatcher *pPatcher = (activeHeaderValid && ! kDirectToActive) ? &patcher : NULL;
+    uint32_t nbrOfBytes = 0;
+#if (MBED_CONF_UPDATE_CLIENT_FRAMED_PROTOCOL == 1)
+    FrameProtocol frameProtocol(_transport, MBED_CONF_UPDATE_CLIENT_FRAME_PAYLOAD_SIZE);
+    bool transferComplete = false;
+    result = receiveFrames(frameProtocol, flashUpdater, pipeline, decoder, pPatcher,
+                           recordLog.isInitialized() ? &downloadProgress : NULL,
+                           candidateApplicationAddress, slotSize, nbrOfBytes, transferComplete);
+#else
+    if (MBED_CONF_UPDATE_CLIENT_DELTA_STREAM && pPatcher == NULL) {
+        tr_error("No active application for applying the patch");
+        result = UC_ERR_INVALID_PATCH;
+    } else {
+        result = receiveStream(pipeline, MBED_CONF_UPDATE_CLIENT_COMPRESSED_STREAM ? &decoder : NULL,
+                               MBED_CONF_UPDATE_CLIENT_DELTA_STREAM ? pPatcher : NULL,
+                               candidateApplicationAddress, slotSize, nbrOfBytes);
+    }
+#endif
+    // a cancellation stops the downloader once the received data is written
+    const int32_t transferResult = result;
+    const int32_t writeResult = pipeline.finish();
+
+    // validate the downloaded application
+    MbedApplication candidateApplication(flashUpdater,
+                                         candidateApplicationAddress,
+                                         candidateApplicationAddress + headerSize);
+    candidateApplication.setVerificationCache(pVerificationCache);
+    result = digest.finish();
+    if (result == UC_ERR_NONE && writeResult == UC_ERR_NONE) {
+        // the header is written once the image is known to be valid
+        result = commitHeader(flashUpdater, pipeline, digest, candidateApplicationAddress, headerSize);
+        if (result == UC_ERR_NONE) {
+            result = candidateApplication.checkApplication(digest);
+        }
+    } else if (result == UC_ERR_NONE) {
+        result = writeResult;
+    }
+    // pages may have been programmed only when the writer was flushed
+    const int32_t recordResult = recordSlotWrite(pipeline);
+    if (result == UC_ERR_NONE) {
+        result = recordResult;
+    }
+    _pendingSlotWrite = NULL;
+    if (result == UC_ERR_NONE) {
+        tr_debug("Candidate application is valid (version %" PRIu64 ")", candidateApplication.getFirmwareVersion());
+        if (kDirectToActive && recordLog.isInitialized()) {
+            // the new active application is started rather than a slot
+            bootSlotRecord.clear();
+        }
+    } else {
+        tr_error("Candidate application is not valid: %" PRIi32 "", result);
+    }
+#if (MBED_CONF_UPDATE_CLIENT_FRAMED_PROTOCOL == 1)
+    if (transferComplete) {
+        // the image was received entirely, a new transfer starts from the first byte
+        if (recordLog.isInitialized()) {
+            downloadProgress.clear(candidateApplicationAddress);
+        }
+        uint8_t resultPayload[4];
+        FrameProtocol::writeUint32(resultPayload, (uint32_t) result);
+        frameProtocol.sendFrame(FrameProtocol::FRAME_RESULT, 0, resultPayload, sizeof(resultPayload));
+    }
+    tr_debug("Nbr of corrupt frames %" PRIu32 "", frameProtocol.getNbrOfCorruptFrames());
+#endif
+
+    flashUpdater.deinit();
+    // the slot holds the received data now
+    _candidateSlotErased = false;
+
+    tr_debug("Nbr of bytes received %" PRIu32 "", nbrOfBytes);
+    const FlashUpdater::VerifyStats &verifyStats = flashUpdater.getVerifyStats();
+    tr_debug("Verify mode %d: %" PRIu32 " of %" PRIu32 " pages verified (%" PRIu32 " failures)",
+             flashUpdater.getVerifyMode(), verifyStats.nbrOfPagesVerified,
+             verifyStats.nbrOfPagesWritten, verifyStats.nbrOfVerifyFailures);
+    tr_debug("Arena peak usage %u bytes (capacity %u bytes)",
+             (unsigned) UpdateClientArena::getPeakSize(), (unsigned) UpdateClientArena::getCapacity());
+
+    return (transferResult == UC_ERR_CANCELLED) ? transferResult : result;
+}
+
+int32_t FirmwareDownloader::receiveStream(FlashWriterPipeline &pipeline, HeatshrinkDecoder *pDecoder,
+                                          DeltaPatcher *pPatcher, uint32_t address, uint32_t maxSize,
+                                          uint32_t &nbrOfBytes)
+{
+    int32_t result = pipeline.start(address, kHeaderCommitSize, 0, maxSize);
+    if (result != UC_ERR_NONE) {
+        tr_error("Cannot start flash writer: %" PRIi32 "", result);
+        return result;
+    }
+    const uint32_t bufferCapacity = pipeline.getBufferCapacity();
+
+    tr_debug("Please send the update file...");
+
+    nbrOfBytes = 0;
+    uint8_t receiveBuffer[kReceiveBufferSize];
+    while (true) {
+        // the transfer ends when the host goes silent once it has started sending
+        const uint32_t timeoutMs = (nbrOfBytes == 0) ? Transport::kWaitForever : MBED_CONF_UPDATE_CLIENT_TRANSFER_TIMEOUT;
+        uint32_t nbrOfBytesRead = 0;
+        if (pDecoder == NULL && pPatcher == NULL) {
+            // plain images are received in place, blocks while all buffers are being programmed
+            FlashWriterPipeline::Buffer *pBuffer = pipeline.getPendingBuffer();
+            result = _transport.read(reinterpret_cast<uint8_t *>(&pBuffer->pData[pBuffer->size]),
+                                     bufferCapacity - pBuffer->size, timeoutMs, nbrOfBytesRead);
+            if (result == UC_ERR_NONE) {
+                pipeline.commitPendingData(nbrOfBytesRead);
+            }
+        } else {
+            result = _transport.read(receiveBuffer, sizeof(receiveBuffer), timeoutMs, nbrOfBytesRead);
+            if (result == UC_ERR_NONE) {
+                result = writeData(pipeline, pDecoder, pPatcher, receiveBuffer, nbrOfBytesRead);
+            }
+        }
+        // the flash writer stops at the first error, such as an image exceeding its area
+        if (result == UC_ERR_NONE) {
+            result = pipeline.getResult();
+        }
+        if (result == UC_ERR_NONE) {
+            result = recordSlotWrite(pipeline);
+        }
+        if (result != UC_ERR_NONE) {
+            tr_debug("Transfer ended: %" PRIi32 "", result);
+            break;
+        }
+
+        // update progress
+        nbrOfBytes += nbrOfBytesRead;
+        printf("Received %05" PRIu32 " bytes\r", nbrOfBytes);
+    }
+
+    return result;
+}
+
+#if (MBED_CONF_UPDATE_CLIENT_FRAMED_PROTOCOL == 1)
+int32_t FirmwareDownloader::receiveFrames(FrameProtocol &frameProtocol, FlashUpdater &flashUpdater,
+                                          FlashWriterPipeline &pipeline, HeatshrinkDecoder &decoder,
+                                          DeltaPatcher *pPatcher, DownloadProgress *pDownloadProgress,
+                                          uint32_t address, uint32_t maxSize, uint32_t &nbrOfBytes, bool &transferComplete)
+{
+    nbrOfBytes = 0;
+    transferComplete = false;
+
+    // wait for the host to announce the image
+    FrameProtocol::Frame frame;
+    int32_t result = UC_ERR_NONE;
+    do {
+        result = frameProtocol.receiveFrame(frame, Transport::kWaitForever);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+    } while (frame.type != FrameProtocol::FRAME_HELLO || frame.length < 8);
+    const uint32_t imageId = FrameProtocol::parseUint32(&frame.pPayload[0]);
+    const uint32_t imageSize = FrameProtocol::parseUint32(&frame.pPayload[4]);
+    const uint32_t flags = (frame.length >= 12) ? FrameProtocol::parseUint32(&frame.pPayload[8]) : 0;
+
+    // an image that does not fit is refused before anything is written
+    if (imageSize > maxSize) {
+        tr_error("Image of %" PRIu32 " bytes does not fit in %" PRIu32 " bytes", imageSize, maxSize);
+        uint8_t resultPayload[4];
+        FrameProtocol::writeUint32(resultPayload, (uint32_t) UC_ERR_IMAGE_TOO_LARGE);
+        frameProtocol.sendFrame(FrameProtocol::FRAME_RESULT, 0, resultPayload, sizeof(resultPayload));
+        return UC_ERR_IMAGE_TOO_LARGE;
+    }
+
+    HeatshrinkDecoder *pDecoder = ((flags & FrameProtocol::HELLO_FLAG_COMPRESSED) != 0) ? &decoder : NULL;
+    if ((flags & FrameProtocol::HELLO_FLAG_DELTA) == 0) {
+        pPatcher = NULL;
+    } else if (pPatcher == NULL) {
+        tr_error("No active application for applying the patch");
+        return UC_ERR_INVALID_PATCH;
+    }
+
+    // the decoder and patcher states cannot be restored, so such images are always received from the start
+    if (pDecoder != NULL || pPatcher != NULL) {
+        if (pDownloadProgress != NULL) {
+            result = pDownloadProgress->clear(address);
+            if (result != UC_ERR_NONE) {
+                return result;
+            }
+            pDownloadProgress = NULL;
+        }
+    }
+
+    // resume from the last sector programmed for this image, if any
+    uint32_t resumeOffset = 0;
+    if (pDownloadProgress != NULL) {
+        resumeOffset = pDownloadProgress->getResumeOffset(address, imageId, imageSize);
+        if (resumeOffset == 0) {
+            result = pDownloadProgress->clear(address);
+            if (result != UC_ERR_NONE) {
+                return result;
+            }
+        }
+    }
+    // the header is programmed last, so a resumed transfer needs the pages holding it again
+    const uint32_t pageSize = flashUpdater.get_page_size();
+    uint32_t headerResendSize = 0;
+    if (resumeOffset > 0) {
+        headerResendSize = ((kHeaderCommitSize + pageSize - 1) / pageSize) * pageSize;
+    }
+    tr_debug("Receiving image 0x%08" PRIx32 " of %" PRIu32 " bytes from offset %" PRIu32 " (flags 0x%" PRIx32 ")",
+             imageId, imageSize, resumeOffset, flags);
+
+    // the pipeline hashes what was received before, so that the digest covers the whole image
+    result = pipeline.start(address, kHeaderCommitSize, resumeOffset, maxSize);
+    if (result != UC_ERR_NONE) {
+        tr_error("Cannot start flash writer: %" PRIi32 "", result);
+        return result;
+    }
+
+    uint8_t payload[16];
+    FrameProtocol::writeUint32(&payload[0], resumeOffset);
+    FrameProtocol::writeUint32(&payload[4], frameProtocol.getMaxPayloadSize());
+    FrameProtocol::writeUint32(&payload[8], kWindowSize);
+    FrameProtocol::writeUint32(&payload[12], headerResendSize);
+    result = frameProtocol.sendFrame(FrameProtocol::FRAME_HELLO_ACK, 0, payload, sizeof(payload));
+    if (result != UC_ERR_NONE) {
+        return result;
+    }
+
+    uint32_t expectedSequence = 0;
+    uint32_t expectedOffset = (headerResendSize > 0) ? 0 : resumeOffset;
+    uint32_t recordedOffset = resumeOffset;
+    uint32_t nbrOfFramesSinceAck = 0;
+    uint32_t nbrOfTimeouts = 0;
+    bool nakSent = false;
+    while (true) {
+        result = frameProtocol.receiveFrame(frame, MBED_CONF_UPDATE_CLIENT_TRANSFER_TIMEOUT);
+        if (result == UC_ERR_TIMEOUT && ++nbrOfTimeouts < kMaxNbrOfTimeouts) {
+            // the host may be waiting for an acknowledgement that was lost
+            FrameProtocol::writeUint32(payload, expectedOffset);
+            result = frameProtocol.sendFrame(FrameProtocol::FRAME_ACK, expectedSequence, payload, 4);
+            nbrOfFramesSinceAck = 0;
+        }
+        if (result == UC_ERR_TIMEOUT) {
+            continue;
+        }
+        if (result != UC_ERR_NONE) {
+            tr_debug("Transfer ended: %" PRIi32 "", result);
+            break;
+        }
+        nbrOfTimeouts = 0;
+
+        if (frame.type == FrameProtocol::FRAME_END && frame.sequence == expectedSequence) {
+            transferComplete = true;
+            break;
+        }
+        if (frame.type != FrameProtocol::FRAME_DATA && frame.type != FrameProtocol::FRAME_END) {
+            continue;
+        }
+
+        // frames are accepted in order only, the host goes back to the first missing frame
+        const uint32_t dataOffset = (frame.length >= 4) ? FrameProtocol::parseUint32(frame.pPayload) : 0;
+        if (frame.type == FrameProtocol::FRAME_END || frame.sequence != expectedSequence ||
+                frame.length < 4 || dataOffset != expectedOffset) {
+            if (! nakSent) {
+                result = frameProtocol.sendFrame(FrameProtocol::FRAME_NAK, expectedSequence, NULL, 0);
+                nakSent = true;
+            }
+            continue;
+        }
+        nakSent = false;
+
+        // data beyond the announced image is refused
+        if (dataOffset > imageSize || (uint32_t) frame.length - 4 > imageSize - dataOffset) {
+            tr_error("Data at offset %" PRIu32 " exceeds the image of %" PRIu32 " bytes", dataOffset, imageSize);
+            FrameProtocol::writeUint32(payload, (uint32_t) UC_ERR_IMAGE_TOO_LARGE);
+            frameProtocol.sendFrame(FrameProtocol::FRAME_RESULT, 0, payload, 4);
+            result = UC_ERR_IMAGE_TOO_LARGE;
+            break;
+        }
+
+        // hand the data to the flash writer, the resent header is followed by the data
+        // from the resume offset
+        uint32_t dataSize = frame.length - 4;
+        const bool isHeaderData = (expectedOffset < headerResendSize);
+        if (isHeaderData && dataSize > headerResendSize - expectedOffset) {
+            dataSize = headerResendSize - expectedOffset;
+        }
+        result = writeData(pipeline, pDecoder, pPatcher, &frame.pPayload[4], dataSize);
+        // the flash writer stops at the first error, such as an image exceeding its area
+        if (result == UC_ERR_NONE) {
+            result = pipeline.getResult();
+        }
+        if (result == UC_ERR_NONE) {
+            result = recordSlotWrite(pipeline);
+        }
+        if (result != UC_ERR_NONE) {
+            tr_error("Cannot write received data: %" PRIi32 "", result);
+            break;
+        }
+        expectedSequence++;
+        expectedOffset += dataSize;
+        if (isHeaderData && expectedOffset == headerResendSize) {
+            expectedOffset = resumeOffset;
+        }
+        nbrOfBytes += dataSize;
+
+        if (++nbrOfFramesSinceAck >= kWindowSize / 2) {
+            FrameProtocol::writeUint32(payload, expectedOffset);
+            frameProtocol.sendFrame(FrameProtocol::FRAME_ACK, expectedSequence, payload, 4);
+            nbrOfFramesSinceAck = 0;
+        }
+
+        // record the sectors that are completely programmed
+        if (pDownloadProgress != NULL) {
+            const uint32_t programmedOffset = flashUpdater.alignAddressToSector(
+                                                  address + pipeline.getProgrammedSize(), true) - address;
+            if (programmedOffset > recordedOffset) {
+                pDownloadProgress->setProgrammedSize(address, imageId, imageSize, programmedOffset);
+                recordedOffset = programmedOffset;
+            }
+        }
+    }
+
+    return result;
+}
+#endif
+
+int32_t FirmwareDownloader::writeData(FlashWriterPipeline &pipeline, HeatshrinkDecoder *pDecoder,
+                                      DeltaPatcher *pPatcher, const uint8_t *pData, uint32_t size)
+{
+    if (pDecoder == NULL) {
+        return writePatchedData(pipeline, pPatcher, pData, size);
+    }
+
+    // decompress until the input is consumed and all back references are copied,
+    // directly into the pipeline buffers unless the result is a patch
+    const uint32_t bufferCapacity = pipeline.getBufferCapacity();
+    uint8_t decodedBuffer[kReceiveBufferSize];
+    while (size > 0 || ! pDecoder->needsInput()) {
+        uint8_t *pOutput = decodedBuffer;
+        uint32_t outputSize = sizeof(decodedBuffer);
+        if (pPatcher == NULL) {
+            FlashWriterPipeline::Buffer *pBuffer = pipeline.getPendingBuffer();
+            pOutput = reinterpret_cast<uint8_t *>(&pBuffer->pData[pBuffer->size]);
+            outputSize = bufferCapacity - pBuffer->size;
+        }
+        uint32_t nbrOfBytesConsumed = 0;
+        uint32_t nbrOfBytesProduced = 0;
+        pDecoder->decode(pData, size, nbrOfBytesConsumed, pOutput, outputSize, nbrOfBytesProduced);
+        pData += nbrOfBytesConsumed;
+        size -= nbrOfBytesConsumed;
+        if (pPatcher == NULL) {
+            pipeline.commitPendingData(nbrOfBytesProduced);
+        } else {
+            int32_t result = writePatchedData(pipeline, pPatcher, decodedBuffer, nbrOfBytesProduced);
+            if (result != UC_ERR_NONE) {
+                return result;
+            }
+        }
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t FirmwareDownloader::writePatchedData(FlashWriterPipeline &pipeline, DeltaPatcher *pPatcher,
+                                             const uint8_t *pData, uint32_t size)
+{
+    if (pPatcher == NULL) {
+        pipeline.append(reinterpret_cast<const char *>(pData), size);
+        return UC_ERR_NONE;
+    }
+
+    // patch directly into the pipeline buffers, until the input is consumed
+    // and all copies from the active application are done
+    const uint32_t bufferCapacity = pipeline.getBufferCapacity();
+    while (size > 0 || ! pPatcher->needsInput()) {
+        FlashWriterPipeline::Buffer *pBuffer = pipeline.getPendingBuffer();
+        uint32_t nbrOfBytesConsumed = 0;
+        uint32_t nbrOfBytesProduced = 0;
+        int32_t result = pPatcher->apply(pData, size, nbrOfBytesConsumed,
+                                         reinterpret_cast<uint8_t *>(&pBuffer->pData[pBuffer->size]),
+                                         bufferCapacity - pBuffer->size, nbrOfBytesProduced);
+        pipeline.commitPendingData(nbrOfBytesProduced);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        pData += nbrOfBytesConsumed;
+        size -= nbrOfBytesConsumed;
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t FirmwareDownloader::commitHeader(FlashUpdater &flashUpdater, FlashWriterPipeline &pipeline,
+                                         const ApplicationDigest &digest, uint32_t address, uint32_t headerSize)
+{
+    const ApplicationDigest *pDigest = &digest;
+    ApplicationDigest flashDigest(headerSize);
+    if (flashUpdater.getVerifyMode() == FlashUpdater::VERIFY_SAMPLED ||
+            flashUpdater.getVerifyMode() == FlashUpdater::VERIFY_DEFERRED) {
+        // not all pages were verified while writing, hash the image from flash so that the
+        // verification cache only records images known to be in flash
+        // (the deferred header is not programmed yet)
+        uint32_t deferredSize = 0;
+        const char *pDeferredData = pipeline.getDeferredData(deferredSize);
+        flashDigest.update(reinterpret_cast<const uint8_t *>(pDeferredData), deferredSize);
+        int32_t result = flashDigest.updateFromFlash(flashUpdater, address + deferredSize,
+                                                     headerSize + (uint32_t) digest.getFirmwareSize() - deferredSize);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        flashDigest.finish();
+        pDigest = &flashDigest;
+    }
+
+    int32_t result = pDigest->checkHeader();
+    if (result != UC_ERR_NONE) {
+        tr_error("Image does not match its header: %" PRIi32 "", result);
+        return result;
+    }
+
+    return pipeline.commitDeferredData();
+}
+
+int32_t FirmwareDownloader::recordSlotWrite(const FlashWriterPipeline &pipeline)
+{
+    // the slot wear is recorded by the downloader thread, the record log is not shared
+    // with the flash writer
+    if (_pendingSlotWrite == NULL || pipeline.getPagesFlashed() == 0) {
+        return UC_ERR_NONE;
+    }
+    const int32_t result = _pendingSlotWrite->recordSlotWrite(_pendingSlotIndex);
+    if (result != UC_ERR_NONE) {
+        tr_error("Cannot record write of slot %" PRIu32 ": %" PRIi32 "", _pendingSlotIndex, result);
+    }
+    _pendingSlotWrite = NULL;
+
+    return result;
+}
+
+uint32_t FirmwareDownloader::getActiveRegionSize(FlashUpdater &flashUpdater)
+{
+    // the active application ends where the storage or the metadata area starts
+    uint32_t endAddress = flashUpdater.get_flash_start() + flashUpdater.get_flash_size();
+    const uint32_t storageAddress = MBED_CONF_UPDATE_CLIENT_STORAGE_ADDRESS;
+    if (MBED_CONF_UPDATE_CLIENT_STORAGE_SIZE > 0 && storageAddress > HEADER_ADDR && storageAddress < endAddress) {
+        endAddress = storageAddress;
+    }
+    const uint32_t metadataAddress = MBED_CONF_UPDATE_CLIENT_METADATA_ADDRESS;
+    if (MBED_CONF_UPDATE_CLIENT_METADATA_SIZE > 0 && metadataAddress > HEADER_ADDR && metadataAddress < endAddress) {
+        endAddress = metadataAddress;
+    }
+
+    return endAddress - HEADER_ADDR;
+}
+
+bool FirmwareDownloader::preEraseCandidateSlot()
+{
+    UpdateClientArena::Session arenaSession;
+
+    FlashUpdater flashUpdater;
+    int err = flashUpdater.init();
+    if (0 != err) {
+        tr_error("Init flash failed: %d", err);
+        return false;
+    }
+
+    const uint32_t headerSize = APPLICATION_ADDR - HEADER_ADDR;
+    std::unique_ptr<CandidateApplications> candidateApplications = std::unique_ptr<CandidateApplications>(
+        createCandidateApplications(flashUpdater,
+                                    MBED_CONF_UPDATE_CLIENT_STORAGE_ADDRESS,
+                                    MBED_CONF_UPDATE_CLIENT_STORAGE_SIZE,
+                                    headerSize,
+                                    MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS));
+
+    // the verification of the erased application must be forgotten
+    FlashRecordLog recordLog(flashUpdater,
+                             MBED_CONF_UPDATE_CLIENT_METADATA_ADDRESS,
+                             MBED_CONF_UPDATE_CLIENT_METADATA_SIZE);
+    VerificationCache verificationCache(recordLog);
+    BootSlotRecord bootSlotRecord(recordLog);
+    SlotWearRecord slotWearRecord(recordLog);
+    DownloadProgress downloadProgress(recordLog);
+    if (MBED_CONF_UPDATE_CLIENT_METADATA_SIZE > 0) {
+        int32_t result = recordLog.init();
+        if (result != UC_ERR_NONE) {
+            tr_error("Cannot initialize metadata area: %" PRIi32 "", result);
+            return false;
+        }
+        candidateApplications.get()->setVerificationCache(&verificationCache);
+        candidateApplications.get()->setBootSlotRecord(&bootSlotRecord);
+        candidateApplications.get()->setSlotWearRecord(&slotWearRecord);
+        candidateApplications.get()->setDownloadProgress(&downloadProgress);
+    }
+
+    const uint32_t slotIndex = candidateApplications.get()->getSlotForCandidate();
+#if (MBED_CONF_UPDATE_CLIENT_FRAMED_PROTOCOL == 1)
+    // a partially received image is kept for resuming its transfer
+    uint32_t candidateAddress = 0;
+    uint32_t slotSize = 0;
+    if (recordLog.isInitialized() &&
+            candidateApplications.get()->getCandidateAddress(slotIndex, candidateAddress, slotSize) == UC_ERR_NONE &&
+            downloadProgress.isInProgress(candidateAddress)) {
+        tr_debug("Slot %" PRIu32 " holds a partial image, not erased", slotIndex);
+        return true;
+    }
+#endif
+    tr_debug("Pre-erasing slot %" PRIu32 "", slotIndex);
+    int32_t result = candidateApplications.get()->eraseSlot(slotIndex);
+    candidateApplications.reset();
+    flashUpdater.deinit();
+
+    return result == UC_ERR_NONE;
+}
+
+#endif
+
+} // namespace update_client
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "mbed.h"
+
+#include "application_digest.hpp"
+#include "candidate_applications.hpp"
+#include "delta_patcher.hpp"
+#include "download_progress.hpp"
+#include "flash_updater.hpp"
+#include "flash_writer_pipeline.hpp"
+#include "frame_protocol.hpp"
+#include "heatshrink_decoder.hpp"
+#include "integrity_scrubber.hpp"
+#include "uc_transport.hpp"
+
+namespace update_client {
+
+#if (USE_USB_SERIAL_UC == 1) || (USE_BUFFERED_SERIAL_UC == 1) || (USE_SOCKET_TRANSPORT_UC == 1)
+
+// FirmwareDownloader receives updates over a transport and stores them in the candidate slot
+// The reception and the programming of the flash are pipelined, independently of the transport
+// The image is received either as a raw stream, which ends when the host disconnects or when
+// no data is received for MBED_CONF_UPDATE_CLIENT_TRANSFER_TIMEOUT milliseconds, or with the
+// framed protocol (see FrameProtocol), which resumes interrupted transfers. Images may be
+// compressed with heatshrink, they are then decompressed before being programmed, and may be
+// patches against the active application (see DeltaPatcher), which are applied after decompression
+// The header of an image is written last, once the image is verified, so that an incomplete
+// image never has a valid header. In bootloader builds configured with
+// update-client.direct-to-active, images are written over the active application instead of
+// a candidate slot
+
+class FirmwareDownloader {
+public:
+    // constructor
+    explicit FirmwareDownloader(Transport &transport);
+
+    // methods for starting and stopping the downloader thread
+    void start();
+    void stop();
+
+    // receive one update from the connected host
+    int32_t downloadFirmware();
+    // pause the integrity scrubber while the flash is erased or written
+    void setIntegrityScrubber(IntegrityScrubber *integrityScrubber);
+
+private:
+    // private methods
+    void run();
+    // images are written from address and must fit in maxSize bytes
+    int32_t receiveStream(FlashWriterPipeline &pipeline, HeatshrinkDecoder *pDecoder,
+                          DeltaPatcher *pPatcher, uint32_t address, uint32_t maxSize,
+                          uint32_t &nbrOfBytes);
+#if (MBED_CONF_UPDATE_CLIENT_FRAMED_PROTOCOL == 1)
+    int32_t receiveFrames(FrameProtocol &frameProtocol, FlashUpdater &flashUpdater,
+                          FlashWriterPipeline &pipeline, HeatshrinkDecoder &decoder,
+                          DeltaPatcher *pPatcher, DownloadProgress *pDownloadProgress,
+                          uint32_t address, uint32_t maxSize, uint32_t &nbrOfBytes, bool &transferComplete);
+#endif
+    // hand received data to the flash writer, decompressing and patching it if a decoder
+    // and a patcher are given
+    int32_t writeData(FlashWriterPipeline &pipeline, HeatshrinkDecoder *pDecoder,
+                      DeltaPatcher *pPatcher, const uint8_t *pData, uint32_t size);
+    int32_t writePatchedData(FlashWriterPipeline &pipeline, DeltaPatcher *pPatcher,
+                             const uint8_t *pData, uint32_t size);
+    // check the image against its deferred header and program the header
+    int32_t commitHeader(FlashUpdater &flashUpdater, FlashWriterPipeline &pipeline,
+                         const ApplicationDigest &digest, uint32_t address, uint32_t headerSize);
+    // record the write of the candidate slot once its first page is programmed
+    int32_t recordSlotWrite(const FlashWriterPipeline &pipeline);
+    // erase the slot that will receive the next candidate, returns true on success
+    bool preEraseCandidateSlot();
+    // size of the area from HEADER_ADDR that the active application may use
+    static uint32_t getActiveRegionSize(FlashUpdater &flashUpdater);
+
+    // data members
+    Transport &_transport;
+    Thread _downloaderThread;
+    IntegrityScrubber *_integrityScrubber;
+    bool _candidateSlotErased;
+    // candidate slot whose write is recorded once a page is programmed into it
+    CandidateApplications *_pendingSlotWrite;
+    uint32_t _pendingSlotIndex;
+#if defined(POST_APPLICATION_ADDR) && (MBED_CONF_UPDATE_CLIENT_DIRECT_TO_ACTIVE == 1)
+    // the bootloader receives updates directly into the active application
+    static constexpr bool kDirectToActive = true;
+#else
+    static constexpr bool kDirectToActive = false;
+#endif
+    // the header is written last, once the image is valid, so that an incomplete image has
+    // no valid header
+    static constexpr uint32_t kHeaderCommitSize = MbedApplication::kHeaderSizeV2;
+    static constexpr uint32_t kWindowSize = MBED_CONF_UPDATE_CLIENT_FRAME_WINDOW_SIZE;
+    // consecutive timeouts after which the host is considered gone
+    static constexpr uint32_t kMaxNbrOfTimeouts = 5;
+    static constexpr uint32_t kReceiveBufferSize = 256;
+};
+
+#endif
+
+} // namespace update_client
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "mbed.h"
+
+#include "uc_arena.hpp"
+
+namespace update_client {
+
+// UniformFlashGeometry computes the layout of the candidate slots at compile time for
+// storage areas made of sectors of identical size. It follows the same rules as
+// CandidateApplications::getCandidateAddress: the storage area is shrunk to sector
+// boundaries and each slot starts and ends on a sector boundary
+
+template <uint32_t FlashStart, uint32_t SectorSize, uint32_t PageSize,
+          uint32_t StorageAddress, uint32_t StorageSize, uint32_t NbrOfSlots>
+struct UniformFlashGeometry {
+    static_assert(SectorSize > 0 && PageSize > 0 && (SectorSize % PageSize) == 0,
+                  "sectors must be made of whole pages");
+    static_assert(StorageAddress >= FlashStart, "storage must be located in flash");
+    static_assert(NbrOfSlots > 0, "at least one slot is required");
+
+    static constexpr uint32_t kPageSize = PageSize;
+    static constexpr uint32_t kSectorSize = SectorSize;
+    static constexpr uint32_t kNbrOfSlots = NbrOfSlots;
+
+    static constexpr uint32_t alignDown(uint32_t address)
+    {
+        return address - ((address - FlashStart) % SectorSize);
+    }
+    static constexpr uint32_t alignUp(uint32_t address)
+    {
+        return alignDown(address + SectorSize - 1);
+    }
+
+    static constexpr uint32_t kStorageStartAddress = alignUp(StorageAddress);
+    static constexpr uint32_t kStorageEndAddress = alignDown(StorageAddress + StorageSize);
+    static constexpr uint32_t kMaxSlotSize = (kStorageEndAddress - kStorageStartAddress) / NbrOfSlots;
+    static_assert(kStorageEndAddress > kStorageStartAddress && kMaxSlotSize >= SectorSize,
+                  "storage is too small for the number of slots");
+
+    static constexpr uint32_t getSlotAddress(uint32_t slotIndex)
+    {
+        return alignDown(kStorageStartAddress + slotIndex * kMaxSlotSize);
+    }
+    static constexpr uint32_t getSlotSize(uint32_t slotIndex)
+    {
+        return alignDown(getSlotAddress(slotIndex) + kMaxSlotSize) - getSlotAddress(slotIndex);
+    }
+};
+
+// the geometry of the board is known at compile time if the sector size of the storage area is configured
+#if (MBED_CONF_UPDATE_CLIENT_UNIFORM_SECTOR_SIZE > 0)
+typedef UniformFlashGeometry<MBED_ROM_START,
+                             MBED_CONF_UPDATE_CLIENT_UNIFORM_SECTOR_SIZE,
+                             MBED_CONF_UPDATE_CLIENT_PAGE_SIZE,
+                             MBED_CONF_UPDATE_CLIENT_STORAGE_ADDRESS,
+                             MBED_CONF_UPDATE_CLIENT_STORAGE_SIZE,
+                             MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS> BoardFlashGeometry;
+#endif
+
+// PageBuffer holds one flash page. The buffer is statically sized when the geometry of
+// the board is known at compile time and allocated from the update client arena otherwise
+
+class PageBuffer {
+public:
+    explicit PageBuffer(uint32_t pageSize)
+#if (MBED_CONF_UPDATE_CLIENT_UNIFORM_SECTOR_SIZE > 0)
+    {
+        MBED_ASSERT(pageSize == BoardFlashGeometry::kPageSize);
+        (void) pageSize;
+    }
+#else
+        : _pBuffer(static_cast<char *>(UpdateClientArena::allocate(pageSize)))
+    {
+
+    }
+    ~PageBuffer()
+    {
+        UpdateClientArena::release(_pBuffer);
+    }
+#endif
+
+    char *get()
+    {
+#if (MBED_CONF_UPDATE_CLIENT_UNIFORM_SECTOR_SIZE > 0)
+        return _buffer;
+#else
+        return _pBuffer;
+#endif
+    }
+
+private:
+    // not copyable
+    PageBuffer(const PageBuffer &);
+    PageBuffer &operator=(const PageBuffer &);
+
+#if (MBED_CONF_UPDATE_CLIENT_UNIFORM_SECTOR_SIZE > 0)
+    MBED_ALIGN(4) char _buffer[BoardFlashGeometry::kPageSize];
+#else
+    char *_pBuffer;
+#endif
+};
+
+} // namespace update_client
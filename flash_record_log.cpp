@@ -0,0 +1,336 @@
+#include "flash_record_log.hpp"
+#include "uc_crc32.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "FlashRecordLog"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+FlashRecordLog::FlashRecordLog(FlashUpdater &flashUpdater, uint32_t address, uint32_t size) :
+    _flashUpdater(flashUpdater),
+    _address(address),
+    _size(size),
+    _halfSize(0),
+    _recordStride(0),
+    _nbrOfRecordsPerHalf(0),
+    _activeHalf(0),
+    _generation(0),
+    _nextRecordIndex(0),
+    _initialized(false)
+{
+
+}
+
+int32_t FlashRecordLog::init()
+{
+    _initialized = false;
+    if (_size == 0) {
+        return UC_ERR_INVALID_PARAMETER;
+    }
+
+    // records are programmed one by one, so each record occupies whole pages
+    const uint32_t pageSize = _flashUpdater.get_page_size();
+    _recordStride = ((sizeof(Record) + pageSize - 1) / pageSize) * pageSize;
+    if (_recordStride > kMaxRecordStride) {
+        tr_error(" Page size %" PRIu32 " is too large for records", pageSize);
+        return UC_ERR_INVALID_PARAMETER;
+    }
+
+    // each half must be made of whole sectors, since halves are erased independently
+    _halfSize = _size / 2;
+    if (_flashUpdater.alignAddressToSector(_address, true) != _address ||
+            _flashUpdater.alignAddressToSector(_address + _halfSize, true) != _address + _halfSize ||
+            _flashUpdater.alignAddressToSector(_address + _size, true) != _address + _size) {
+        tr_error(" Record log area 0x%08" PRIx32 " (size %" PRIu32 ") is not sector aligned", _address, _size);
+        return UC_ERR_INVALID_PARAMETER;
+    }
+    _nbrOfRecordsPerHalf = _halfSize / _recordStride;
+
+    // the active half is the one with a valid generation record and the highest generation
+    bool isHalfValid[2] = { false, false };
+    uint32_t generation[2] = { 0, 0 };
+    for (uint32_t halfIndex = 0; halfIndex < 2; halfIndex++) {
+        Record record;
+        bool isEmpty = true;
+        int32_t result = readRecord(halfIndex, 0, record, isEmpty);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        if (! isEmpty && record.magic == kRecordMagic && record.crc == computeRecordCrc(record) &&
+                record.type == kGenerationRecordType) {
+            isHalfValid[halfIndex] = true;
+            generation[halfIndex] = record.values[0];
+        }
+    }
+
+    if (isHalfValid[0] && isHalfValid[1]) {
+        _activeHalf = ((int32_t)(generation[1] - generation[0]) > 0) ? 1 : 0;
+    } else if (isHalfValid[0] || isHalfValid[1]) {
+        _activeHalf = isHalfValid[0] ? 0 : 1;
+    } else {
+        tr_debug(" Formatting record log at address 0x%08" PRIx32 "", _address);
+        int32_t result = format(0, 1);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        isHalfValid[0] = true;
+        generation[0] = 1;
+        _activeHalf = 0;
+    }
+    _generation = generation[_activeHalf];
+
+    // find the end of the log, records that were partially written are skipped
+    _nextRecordIndex = 1;
+    for (uint32_t recordIndex = 1; recordIndex < _nbrOfRecordsPerHalf; recordIndex++) {
+        Record record;
+        bool isEmpty = true;
+        int32_t result = readRecord(_activeHalf, recordIndex, record, isEmpty);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        if (isEmpty) {
+            break;
+        }
+        _nextRecordIndex = recordIndex + 1;
+    }
+    tr_debug(" Record log uses half %" PRIu32 " (generation %" PRIu32 ", %" PRIu32 " records)",
+             _activeHalf, _generation, _nextRecordIndex - 1);
+
+    _initialized = true;
+    return UC_ERR_NONE;
+}
+
+bool FlashRecordLog::isInitialized() const
+{
+    return _initialized;
+}
+
+int32_t FlashRecordLog::find(uint16_t type, uint32_t key, Record &record)
+{
+    if (! _initialized) {
+        return UC_ERR_INVALID_PARAMETER;
+    }
+
+    // walk the log backwards, the first match is the latest record
+    for (uint32_t recordIndex = _nextRecordIndex - 1; recordIndex > 0; recordIndex--) {
+        bool isEmpty = true;
+        int32_t result = readRecord(_activeHalf, recordIndex, record, isEmpty);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        if (isEmpty || record.magic != kRecordMagic || record.crc != computeRecordCrc(record)) {
+            continue;
+        }
+        if (record.type == type && record.key == key) {
+            return ((record.flags & kFlagRemoved) != 0) ? UC_ERR_NOT_FOUND : UC_ERR_NONE;
+        }
+    }
+
+    return UC_ERR_NOT_FOUND;
+}
+
+int32_t FlashRecordLog::write(uint16_t type, uint32_t key, const uint32_t values[kNbrOfValues])
+{
+    if (type == kGenerationRecordType) {
+        return UC_ERR_INVALID_PARAMETER;
+    }
+    return append(type, 0, key, values);
+}
+
+int32_t FlashRecordLog::remove(uint16_t type, uint32_t key)
+{
+    Record record;
+    int32_t result = find(type, key, record);
+    if (result == UC_ERR_NOT_FOUND) {
+        // nothing to remove
+        return UC_ERR_NONE;
+    }
+    if (result != UC_ERR_NONE) {
+        return result;
+    }
+
+    const uint32_t values[kNbrOfValues] = { 0 };
+    return append(type, kFlagRemoved, key, values);
+}
+
+bool FlashRecordLog::needsCompaction() const
+{
+    return _initialized && _nextRecordIndex >= _nbrOfRecordsPerHalf;
+}
+
+int32_t FlashRecordLog::readRecord(uint32_t halfIndex, uint32_t recordIndex, Record &record, bool &isEmpty)
+{
+    int err = _flashUpdater.read(&record, getHalfAddress(halfIndex) + recordIndex * _recordStride, sizeof(Record));
+    if (err != 0) {
+        tr_error("Flash read failed: %d", err);
+        return UC_ERR_READING_FLASH;
+    }
+
+    // a record is empty if it was never programmed since the last erase
+    const uint8_t eraseValue = _flashUpdater.get_erase_value();
+    const uint8_t *pRecord = reinterpret_cast<const uint8_t *>(&record);
+    isEmpty = true;
+    for (uint32_t index = 0; index < sizeof(Record); index++) {
+        if (pRecord[index] != eraseValue) {
+            isEmpty = false;
+            break;
+        }
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t FlashRecordLog::programRecord(uint32_t halfIndex, uint32_t recordIndex, const Record &record)
+{
+    uint8_t programBuffer[kMaxRecordStride];
+    memset(programBuffer, _flashUpdater.get_erase_value(), _recordStride);
+    memcpy(programBuffer, &record, sizeof(Record));
+
+    const uint32_t recordAddress = getHalfAddress(halfIndex) + recordIndex * _recordStride;
+    int err = _flashUpdater.program(programBuffer, recordAddress, _recordStride);
+    if (err != 0) {
+        tr_error("Flash program failed: %d", err);
+        return UC_ERR_WRITE_FAILED;
+    }
+
+    // check that was written is correct
+    Record readRecord;
+    err = _flashUpdater.read(&readRecord, recordAddress, sizeof(Record));
+    if (err != 0 || memcmp(&readRecord, &record, sizeof(Record)) != 0) {
+        tr_error("Write and read differ");
+        return UC_ERR_WRITE_FAILED;
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t FlashRecordLog::append(uint16_t type, uint16_t flags, uint32_t key, const uint32_t values[kNbrOfValues])
+{
+    if (! _initialized) {
+        return UC_ERR_INVALID_PARAMETER;
+    }
+
+    if (_nextRecordIndex >= _nbrOfRecordsPerHalf) {
+        int32_t result = compact();
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        if (_nextRecordIndex >= _nbrOfRecordsPerHalf) {
+            tr_error(" Record log is full");
+            return UC_ERR_WRITE_FAILED;
+        }
+    }
+
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.magic = kRecordMagic;
+    record.type = type;
+    record.flags = flags;
+    record.key = key;
+    memcpy(record.values, values, sizeof(record.values));
+    record.crc = computeRecordCrc(record);
+
+    // the index is consumed even if programming fails, since the slot is no longer erased
+    const uint32_t recordIndex = _nextRecordIndex++;
+    return programRecord(_activeHalf, recordIndex, record);
+}
+
+int32_t FlashRecordLog::format(uint32_t halfIndex, uint32_t generation)
+{
+    int err = _flashUpdater.erase(getHalfAddress(halfIndex), _halfSize);
+    if (err != 0) {
+        tr_error("Flash erase failed: %d", err);
+        return UC_ERR_WRITE_FAILED;
+    }
+
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.magic = kRecordMagic;
+    record.type = kGenerationRecordType;
+    record.values[0] = generation;
+    record.crc = computeRecordCrc(record);
+
+    return programRecord(halfIndex, 0, record);
+}
+
+int32_t FlashRecordLog::compact()
+{
+    const uint32_t otherHalf = 1 - _activeHalf;
+    tr_debug(" Compacting record log into half %" PRIu32 "", otherHalf);
+
+    int err = _flashUpdater.erase(getHalfAddress(otherHalf), _halfSize);
+    if (err != 0) {
+        tr_error("Flash erase failed: %d", err);
+        return UC_ERR_WRITE_FAILED;
+    }
+
+    // copy the latest records, the generation record is written last so that
+    // the other half only becomes active once the copy is complete
+    uint32_t targetRecordIndex = 1;
+    for (uint32_t recordIndex = 1; recordIndex < _nextRecordIndex; recordIndex++) {
+        Record record;
+        bool isEmpty = true;
+        int32_t result = readRecord(_activeHalf, recordIndex, record, isEmpty);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        if (isEmpty || record.magic != kRecordMagic || record.crc != computeRecordCrc(record) ||
+                (record.flags & kFlagRemoved) != 0 || ! isLatest(recordIndex, record)) {
+            continue;
+        }
+        result = programRecord(otherHalf, targetRecordIndex, record);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        targetRecordIndex++;
+    }
+
+    Record generationRecord;
+    memset(&generationRecord, 0, sizeof(generationRecord));
+    generationRecord.magic = kRecordMagic;
+    generationRecord.type = kGenerationRecordType;
+    generationRecord.values[0] = _generation + 1;
+    generationRecord.crc = computeRecordCrc(generationRecord);
+    int32_t result = programRecord(otherHalf, 0, generationRecord);
+    if (result != UC_ERR_NONE) {
+        return result;
+    }
+
+    _activeHalf = otherHalf;
+    _generation++;
+    _nextRecordIndex = targetRecordIndex;
+
+    return UC_ERR_NONE;
+}
+
+bool FlashRecordLog::isLatest(uint32_t recordIndex, const Record &record)
+{
+    for (uint32_t laterRecordIndex = recordIndex + 1; laterRecordIndex < _nextRecordIndex; laterRecordIndex++) {
+        Record laterRecord;
+        bool isEmpty = true;
+        if (readRecord(_activeHalf, laterRecordIndex, laterRecord, isEmpty) != UC_ERR_NONE ||
+                isEmpty || laterRecord.magic != kRecordMagic || laterRecord.crc != computeRecordCrc(laterRecord)) {
+            continue;
+        }
+        if (laterRecord.type == record.type && laterRecord.key == record.key) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint32_t FlashRecordLog::getHalfAddress(uint32_t halfIndex) const
+{
+    return _address + halfIndex * _halfSize;
+}
+
+uint32_t FlashRecordLog::computeRecordCrc(const Record &record)
+{
+    return crc32(reinterpret_cast<const uint8_t *>(&record), offsetof(Record, crc));
+}
+
+} // namespace update_client
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "flash_updater.hpp"
+
+namespace update_client {
+
+// FlashRecordLog stores small fixed size records in a dedicated area of the internal flash
+// The area is split in two halves made of whole sectors. Records are appended to the active
+// half and the latest record for a given type and key wins. When the active half is full,
+// the latest records are copied to the other half, which then becomes active, so that a
+// power loss at any time leaves at least one consistent half
+
+class FlashRecordLog {
+public:
+    // number of 32 bit values carried by a record
+    static constexpr uint32_t kNbrOfValues = 4;
+
+    struct Record {
+        uint32_t magic;
+        uint16_t type;
+        uint16_t flags;
+        uint32_t key;
+        uint32_t values[kNbrOfValues];
+        uint32_t crc;
+    };
+
+    // constructor
+    FlashRecordLog(FlashUpdater &flashUpdater, uint32_t address, uint32_t size);
+
+    // locate the active half and the end of the log, formatting the area if required
+    int32_t init();
+    bool isInitialized() const;
+
+    // find the latest record of a given type and key
+    int32_t find(uint16_t type, uint32_t key, Record &record);
+    // append a record, replacing any previous record with the same type and key
+    int32_t write(uint16_t type, uint32_t key, const uint32_t values[kNbrOfValues]);
+    // remove the record with the given type and key
+    int32_t remove(uint16_t type, uint32_t key);
+    // returns true if the next write or remove compacts the log, which erases a half
+    bool needsCompaction() const;
+
+private:
+    // private methods
+    int32_t readRecord(uint32_t halfIndex, uint32_t recordIndex, Record &record, bool &isEmpty);
+    int32_t programRecord(uint32_t halfIndex, uint32_t recordIndex, const Record &record);
+    int32_t append(uint16_t type, uint16_t flags, uint32_t key, const uint32_t values[kNbrOfValues]);
+    int32_t format(uint32_t halfIndex, uint32_t generation);
+    int32_t compact();
+    bool isLatest(uint32_t recordIndex, const Record &record);
+    uint32_t getHalfAddress(uint32_t halfIndex) const;
+
+    static uint32_t computeRecordCrc(const Record &record);
+
+    // data members
+    FlashUpdater &_flashUpdater;
+    const uint32_t _address;
+    const uint32_t _size;
+    uint32_t _halfSize;
+    uint32_t _recordStride;
+    uint32_t _nbrOfRecordsPerHalf;
+    uint32_t _activeHalf;
+    uint32_t _generation;
+    uint32_t _nextRecordIndex;
+    bool _initialized;
+
+    // constants
+    static constexpr uint32_t kRecordMagic = 0x55435247UL;
+    static constexpr uint16_t kGenerationRecordType = 0;
+    static constexpr uint16_t kFlagRemoved = 0x0001;
+    static constexpr uint32_t kMaxRecordStride = 256;
+};
+
+} // namespace update_client
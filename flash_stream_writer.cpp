@@ -0,0 +1,237 @@
+#include "flash_stream_writer.hpp"
+#include "uc_arena.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "FlashStreamWriter"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+FlashStreamWriter::FlashStreamWriter(FlashUpdater &flashUpdater) :
+    _flashUpdater(flashUpdater),
+    _pageSize(flashUpdater.get_page_size()),
+    _tailBuffer(_pageSize),
+    _tailSize(0),
+    _address(0),
+    _nextSectorAddress(0),
+    _sectorErased(false),
+    _pagesFlashed(0),
+    _pDeferredData(NULL),
+    _deferredCapacity(0),
+    _deferredSize(0),
+    _deferredFill(0),
+    _startAddress(0),
+    _resumeOffset(0),
+    _endAddress(0)
+{
+
+}
+
+FlashStreamWriter::~FlashStreamWriter()
+{
+    UpdateClientArena::release(_pDeferredData);
+    _pDeferredData = NULL;
+}
+
+int32_t FlashStreamWriter::start(uint32_t address, uint32_t deferredSize, uint32_t resumeOffset,
+                                 uint32_t maxSize)
+{
+    _endAddress = (maxSize > 0) ? address + maxSize : 0;
+    // without deferred pages, a resumed stream simply starts at the resume offset
+    if (deferredSize == 0) {
+        address += resumeOffset;
+        resumeOffset = 0;
+    }
+    if (_flashUpdater.alignAddressToSector(address, true) != address ||
+            _flashUpdater.alignAddressToSector(address + resumeOffset, true) != address + resumeOffset) {
+        tr_error("Stream must start on a sector boundary (address 0x%08" PRIx32 ")", address + resumeOffset);
+        return UC_ERR_INVALID_PARAMETER;
+    }
+
+    _tailSize = 0;
+    _address = address;
+    _nextSectorAddress = _flashUpdater.getNextSectorAddress(address);
+    _sectorErased = false;
+    _pagesFlashed = 0;
+    _startAddress = address;
+    _resumeOffset = resumeOffset;
+
+    // deferred data is kept as whole pages
+    _deferredSize = ((deferredSize + _pageSize - 1) / _pageSize) * _pageSize;
+    _deferredFill = 0;
+    if (_deferredSize >= _nextSectorAddress - address) {
+        tr_error("Cannot defer %" PRIu32 " bytes in a sector of %" PRIu32 " bytes", _deferredSize, _nextSectorAddress - address);
+        _deferredSize = 0;
+        return UC_ERR_INVALID_PARAMETER;
+    }
+    if (_deferredSize > _deferredCapacity) {
+        UpdateClientArena::release(_pDeferredData);
+        _pDeferredData = static_cast<char *>(UpdateClientArena::allocate(_deferredSize));
+        _deferredCapacity = _deferredSize;
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t FlashStreamWriter::append(const char *pData, uint32_t size)
+{
+    if (_deferredFill < _deferredSize) {
+        uint32_t consumedSize = 0;
+        int32_t result = appendDeferredData(pData, size, consumedSize);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        pData += consumedSize;
+        size -= consumedSize;
+    }
+
+    while (size > 0) {
+        int32_t result = UC_ERR_NONE;
+        uint32_t consumedSize = 0;
+        if (_tailSize > 0 || size < _pageSize) {
+            // complete the pending page
+            consumedSize = (size < _pageSize - _tailSize) ? size : (_pageSize - _tailSize);
+            memcpy(&_tailBuffer.get()[_tailSize], pData, consumedSize);
+            _tailSize += consumedSize;
+            if (_tailSize == _pageSize) {
+                result = writePages(_tailBuffer.get(), _pageSize);
+                _tailSize = 0;
+            }
+        } else {
+            // whole pages are written from the input without copying them
+            consumedSize = size - (size % _pageSize);
+            result = writePages(pData, consumedSize);
+        }
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+
+        pData += consumedSize;
+        size -= consumedSize;
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t FlashStreamWriter::flush()
+{
+    // a stream shorter than the deferred pages is padded as well
+    if (_deferredFill < _deferredSize) {
+        memset(&_pDeferredData[_deferredFill], _flashUpdater.get_erase_value(), _deferredSize - _deferredFill);
+        _deferredFill = _deferredSize;
+        uint32_t consumedSize = 0;
+        int32_t result = appendDeferredData(NULL, 0, consumedSize);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+    }
+    if (_tailSize == 0) {
+        return UC_ERR_NONE;
+    }
+
+    memset(&_tailBuffer.get()[_tailSize], _flashUpdater.get_erase_value(), _pageSize - _tailSize);
+    _tailSize = 0;
+    return writePages(_tailBuffer.get(), _pageSize);
+}
+
+int32_t FlashStreamWriter::commitDeferredData()
+{
+    if (_deferredSize == 0) {
+        return UC_ERR_NONE;
+    }
+
+    // the sector was prepared when the deferred pages were complete, they are still erased
+    int32_t result = _flashUpdater.programPages(_pDeferredData, NULL, _startAddress, _deferredSize);
+    if (result != UC_ERR_NONE) {
+        tr_error("Cannot write deferred pages at address 0x%08" PRIx32 ": %" PRIi32 "", _startAddress, result);
+        return result;
+    }
+    _pagesFlashed += _deferredSize / _pageSize;
+    _deferredSize = 0;
+
+    return UC_ERR_NONE;
+}
+
+const char *FlashStreamWriter::getDeferredData(uint32_t &size) const
+{
+    size = _deferredSize;
+    return _pDeferredData;
+}
+
+uint32_t FlashStreamWriter::getAddress() const
+{
+    return _address;
+}
+
+size_t FlashStreamWriter::getPagesFlashed() const
+{
+    return _pagesFlashed;
+}
+
+int32_t FlashStreamWriter::appendDeferredData(const char *pData, uint32_t size, uint32_t &consumedSize)
+{
+    consumedSize = (size < _deferredSize - _deferredFill) ? size : (_deferredSize - _deferredFill);
+    if (consumedSize > 0) {
+        memcpy(&_pDeferredData[_deferredFill], pData, consumedSize);
+        _deferredFill += consumedSize;
+    }
+    if (_deferredFill == _deferredSize && _address == _startAddress) {
+        if (_resumeOffset > 0) {
+            // the stream continues after the data programmed before the interruption
+            _address = _startAddress + _resumeOffset;
+            _nextSectorAddress = _flashUpdater.getNextSectorAddress(_address);
+            return UC_ERR_NONE;
+        }
+
+        // the first sector is prepared now, and the stream continues after the deferred pages
+        int32_t result = _flashUpdater.prepareSector(_startAddress);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        _sectorErased = true;
+        _address += _deferredSize;
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t FlashStreamWriter::writePages(const char *pData, uint32_t size)
+{
+    // the stream must not spill over the area that follows it
+    if (_endAddress != 0 && _address + size > _endAddress) {
+        tr_error("Stream exceeds its area at address 0x%08" PRIx32 " (end 0x%08" PRIx32 ")", _address + size, _endAddress);
+        return UC_ERR_IMAGE_TOO_LARGE;
+    }
+    while (size > 0) {
+        if (! _sectorErased) {
+            int32_t result = _flashUpdater.prepareSector(_address);
+            if (result != UC_ERR_NONE) {
+                return result;
+            }
+            _sectorErased = true;
+        }
+
+        // program up to the end of the current sector at once
+        const uint32_t programSize = (size < _nextSectorAddress - _address) ? size : (_nextSectorAddress - _address);
+        int32_t result = _flashUpdater.programPages(pData, NULL, _address, programSize);
+        if (result != UC_ERR_NONE) {
+            tr_error("Cannot write pages at address 0x%08" PRIx32 ": %" PRIi32 "", _address, result);
+            return result;
+        }
+
+        _pagesFlashed += programSize / _pageSize;
+        _address += programSize;
+        pData += programSize;
+        size -= programSize;
+        if (_address >= _nextSectorAddress) {
+            _nextSectorAddress = _flashUpdater.getNextSectorAddress(_address);
+            _sectorErased = false;
+        }
+    }
+
+    return UC_ERR_NONE;
+}
+
+} // namespace update_client
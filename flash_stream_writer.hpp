@@ -0,0 +1,70 @@
+#pragma once
+
+#include "mbed.h"
+
+#include "flash_geometry.hpp"
+#include "flash_updater.hpp"
+
+namespace update_client {
+
+// FlashStreamWriter writes a stream of data of any length to consecutive flash addresses
+// Input is combined into whole pages, consecutive pages within a sector are programmed with
+// a single call and sectors are erased (unless blank) before their first page is written.
+// The last partial page is padded with the erase value by flush(). The first pages of the
+// stream may be deferred: they are held in RAM and only programmed by commitDeferredData(),
+// so that an image becomes valid only once its header is written last. A stream that was
+// interrupted resumes with the deferred pages followed by the data from the resume offset
+
+class FlashStreamWriter {
+public:
+    // constructor
+    explicit FlashStreamWriter(FlashUpdater &flashUpdater);
+    ~FlashStreamWriter();
+
+    // start writing a stream at a sector aligned address, deferring the pages that hold
+    // the first deferredSize bytes (which must lie within the first sector). If resumeOffset
+    // is not 0, the stream is programmed up to this sector aligned offset already (except
+    // for the deferred pages) and continues there once the deferred pages are appended.
+    // If maxSize is not 0, nothing is erased or programmed beyond address + maxSize
+    int32_t start(uint32_t address, uint32_t deferredSize = 0, uint32_t resumeOffset = 0,
+                  uint32_t maxSize = 0);
+    // write data of any length after the data already appended
+    int32_t append(const char *pData, uint32_t size);
+    // pad and write the last partial page
+    int32_t flush();
+    // program the deferred pages, once the rest of the stream is flushed
+    int32_t commitDeferredData();
+    // deferred pages not yet programmed, padded with the erase value once flushed
+    const char *getDeferredData(uint32_t &size) const;
+
+    // address where the next page will be written
+    uint32_t getAddress() const;
+    size_t getPagesFlashed() const;
+
+private:
+    // private methods
+    int32_t writePages(const char *pData, uint32_t size);
+    int32_t appendDeferredData(const char *pData, uint32_t size, uint32_t &consumedSize);
+
+    // data members
+    FlashUpdater &_flashUpdater;
+    uint32_t _pageSize;
+    // combines input until a page is complete
+    PageBuffer _tailBuffer;
+    uint32_t _tailSize;
+    uint32_t _address;
+    uint32_t _nextSectorAddress;
+    bool _sectorErased;
+    size_t _pagesFlashed;
+    // pages programmed last
+    char *_pDeferredData;
+    uint32_t _deferredCapacity;
+    uint32_t _deferredSize;
+    uint32_t _deferredFill;
+    uint32_t _startAddress;
+    uint32_t _resumeOffset;
+    // end of the area the stream may write to, 0 if not limited
+    uint32_t _endAddress;
+};
+
+} // namespace update_client
@@ -1,4 +1,5 @@
 #include "flash_updater.hpp"
+#include "uc_crc32.hpp"
 #include "uc_error_codes.hpp"
 
 #include "mbed_trace.h"
@@ -8,9 +9,25 @@
 
 namespace update_client {
 
-FlashUpdater::FlashUpdater()
+FlashUpdater::FlashUpdater() :
+    _nbrOfSectorRuns(0),
+    _flashStartAddress(0),
+    _flashEndAddress(0),
+    _verifyMode((VerifyMode) MBED_CONF_UPDATE_CLIENT_PROGRAM_VERIFY_MODE)
 {
+    memset(_sectorRuns, 0, sizeof(_sectorRuns));
+    memset(&_verifyStats, 0, sizeof(_verifyStats));
+}
 
+int FlashUpdater::init()
+{
+    int err = FlashUpdaterBase::init();
+    if (0 != err) {
+        return err;
+    }
+    buildSectorIndex();
+
+    return err;
 }
 
 int32_t FlashUpdater::readPage(uint32_t pageSize, char *readPageBuffer, uint32_t &addr)
@@ -35,10 +52,8 @@ int32_t FlashUpdater::writePage(uint32_t pageSize, char *writePageBuffer, char *
 
     // Erase this page if it hasn't been erased
     if (!sectorErased) {
-        // tr_debug("Erasing sector of size %d at address 0x%08x", get_sector_size(addr), addr);
-        err = erase(addr, get_sector_size(addr));
+        err = prepareSector(addr);
         if (0 != err) {
-            tr_error("Flash erase failed: %" PRIi32 "", err);
             return err;
         }
         sectorErased = true;
@@ -51,37 +66,65 @@ int32_t FlashUpdater::writePage(uint32_t pageSize, char *writePageBuffer, char *
     //}
 #endif
 
-    // Program page
-    err = program(writePageBuffer, addr, pageSize);
+    // Program page and check that was written is correct
+    err = programPages(writePageBuffer, readPageBuffer, addr, pageSize);
     if (0 != err) {
-        tr_error("Flash program failed: %" PRIi32 " (for %" PRIu32 " bytes)", err, pageSize);
         return err;
     }
-    //tr_debug("Program %d bytes at address 0x%08x", actual, addr);
-
-    // check that was written is correct
-    memset(readPageBuffer, 0, sizeof(char) * pageSize);
-    err = read(readPageBuffer, addr, pageSize);
-    if (0 != err) {
-        tr_error("Flash read failed: %" PRIi32 "", err);
-        return err;
-    }
-    if (memcmp(writePageBuffer, readPageBuffer, pageSize) != 0) {
-        tr_error("Write and read differ");
-        return UC_ERR_WRITE_FAILED;
-    }
 
     // update address and next sector
     pagesFlashed++;
     addr += pageSize;
     if (addr >= nextSectorAddress) {
-        nextSectorAddress = addr + get_sector_size(addr);
+        nextSectorAddress = getNextSectorAddress(addr);
         sectorErased = false;
     }
 
     return err;
 }
 
+int32_t FlashUpdater::prepareSector(uint32_t address)
+{
+    // a blank check is much faster than an erase, the sector may have been erased beforehand
+    const uint32_t sectorSize = getSectorSize(address);
+    bool erased = false;
+    int32_t err = isErased(address, sectorSize, erased);
+    if (0 != err) {
+        return err;
+    }
+    if (! erased) {
+        // tr_debug("Erasing sector of size %d at address 0x%08x", sectorSize, address);
+        err = erase(address, sectorSize);
+        if (0 != err) {
+            tr_error("Flash erase failed: %" PRIi32 "", err);
+            return err;
+        }
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t FlashUpdater::programPages(const char *pData, char *readPageBuffer, uint32_t addr, uint32_t size)
+{
+    int32_t err = program(pData, addr, size);
+    if (0 != err) {
+        tr_error("Flash program failed: %" PRIi32 " (for %" PRIu32 " bytes)", err, size);
+        return err;
+    }
+    //tr_debug("Program %d bytes at address 0x%08x", size, addr);
+
+    // pages are verified one by one, for sampling
+    const uint32_t pageSize = get_page_size();
+    for (uint32_t offset = 0; offset < size; offset += pageSize) {
+        err = verifyPage(&pData[offset], readPageBuffer, addr + offset, pageSize);
+        if (0 != err) {
+            return err;
+        }
+    }
+
+    return UC_ERR_NONE;
+}
+
 uint32_t FlashUpdater::alignAddressToSector(uint32_t address, bool roundDown)
 {
     // default to returning the beginning of the flash
@@ -91,6 +134,16 @@ uint32_t FlashUpdater::alignAddressToSector(uint32_t address, bool roundDown)
     // addresses out of bounds are pinned to the flash boundaries
     if (address >= flashEndAddress) {
         sectorAlignedAddress = flashEndAddress;
+    } else if (address > sectorAlignedAddress && _nbrOfSectorRuns > 0) {
+        // use the index of the sector map
+        const SectorRun *pSectorRun = findSectorRun(address);
+        const uint32_t sectorIndex = (address - pSectorRun->startAddress) / pSectorRun->sectorSize;
+        sectorAlignedAddress = pSectorRun->startAddress + sectorIndex * pSectorRun->sectorSize;
+
+        // if round up to nearest sector, add a sector if not already aligned
+        if (! roundDown && (sectorAlignedAddress != address)) {
+            sectorAlignedAddress += pSectorRun->sectorSize;
+        }
     } else if (address > sectorAlignedAddress) {
         // for addresses within bounds step through the sector map
         uint32_t sectorSize = 0;
@@ -113,6 +166,293 @@ uint32_t FlashUpdater::alignAddressToSector(uint32_t address, bool roundDown)
     return sectorAlignedAddress;
 }
 
+uint32_t FlashUpdater::getSectorSize(uint32_t address)
+{
+    if (_nbrOfSectorRuns > 0 && address >= _flashStartAddress && address < _flashEndAddress) {
+        return findSectorRun(address)->sectorSize;
+    }
+
+    return get_sector_size(address);
+}
+
+uint32_t FlashUpdater::getNextSectorAddress(uint32_t address)
+{
+    return alignAddressToSector(address + 1, false);
+}
+
+const uint8_t *FlashUpdater::getFlashSpan(uint32_t address, uint32_t size)
+{
+    // the whole range must be within the flash
+    const uint32_t flashStart = get_flash_start();
+    const uint32_t flashSize = get_flash_size();
+    if (address < flashStart || size > flashSize || (address - flashStart) > (flashSize - size)) {
+        return NULL;
+    }
+
+#if (USE_SIMULATED_FLASH_UC == 1)
+    return map(address, size);
+#elif MBED_CONF_UPDATE_CLIENT_MEMORY_MAPPED_FLASH
+    // internal flash is mapped at its address
+    return reinterpret_cast<const uint8_t *>(address);
+#else
+    return NULL;
+#endif
+}
+
+int32_t FlashUpdater::isErased(uint32_t address, uint32_t size, bool &erased)
+{
+    const uint8_t eraseValue = get_erase_value();
+    const uint32_t eraseWord = eraseValue * 0x01010101UL;
+
+    erased = true;
+    const uint8_t *pFlash = getFlashSpan(address, size);
+    if (pFlash != NULL) {
+        // scan the flash in place, word by word once aligned
+        uint32_t offset = 0;
+        while (offset < size && (reinterpret_cast<uintptr_t>(&pFlash[offset]) % sizeof(uint32_t)) != 0) {
+            if (pFlash[offset++] != eraseValue) {
+                erased = false;
+                return UC_ERR_NONE;
+            }
+        }
+        for (; offset + sizeof(uint32_t) <= size; offset += sizeof(uint32_t)) {
+            if (*reinterpret_cast<const uint32_t *>(&pFlash[offset]) != eraseWord) {
+                erased = false;
+                return UC_ERR_NONE;
+            }
+        }
+        for (; offset < size; offset++) {
+            if (pFlash[offset] != eraseValue) {
+                erased = false;
+                return UC_ERR_NONE;
+            }
+        }
+        return UC_ERR_NONE;
+    }
+
+    // read the flash in small chunks, the chunk is word aligned
+    uint32_t chunk[kVerifyChunkSize / sizeof(uint32_t)];
+    for (uint32_t offset = 0; offset < size; offset += kVerifyChunkSize) {
+        const uint32_t chunkSize = (size - offset < kVerifyChunkSize) ? (size - offset) : kVerifyChunkSize;
+        // bytes beyond the range are considered erased
+        memset(chunk, eraseValue, sizeof(chunk));
+        int err = read(chunk, address + offset, chunkSize);
+        if (0 != err) {
+            tr_error("Flash read failed: %d", err);
+            return UC_ERR_READING_FLASH;
+        }
+        for (uint32_t wordIndex = 0; wordIndex < kVerifyChunkSize / sizeof(uint32_t); wordIndex++) {
+            if (chunk[wordIndex] != eraseWord) {
+                erased = false;
+                return UC_ERR_NONE;
+            }
+        }
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t FlashUpdater::eraseRange(uint32_t address, uint32_t size, uint32_t &nbrOfSectorsErased)
+{
+    nbrOfSectorsErased = 0;
+    const uint32_t endAddress = address + size;
+    while (address < endAddress) {
+        const uint32_t sectorSize = getSectorSize(address);
+        bool erased = false;
+        int32_t result = isErased(address, sectorSize, erased);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        if (! erased) {
+            int err = erase(address, sectorSize);
+            if (0 != err) {
+                tr_error("Flash erase failed: %d", err);
+                return UC_ERR_WRITE_FAILED;
+            }
+            nbrOfSectorsErased++;
+        }
+        address += sectorSize;
+    }
+
+    return UC_ERR_NONE;
+}
+
+void FlashUpdater::setVerifyMode(VerifyMode verifyMode)
+{
+    _verifyMode = verifyMode;
+}
+
+FlashUpdater::VerifyMode FlashUpdater::getVerifyMode() const
+{
+    return _verifyMode;
+}
+
+const FlashUpdater::VerifyStats &FlashUpdater::getVerifyStats() const
+{
+    return _verifyStats;
+}
+
+void FlashUpdater::resetVerifyStats()
+{
+    memset(&_verifyStats, 0, sizeof(_verifyStats));
+}
+
+int32_t FlashUpdater::verifyPage(const char *writePageBuffer, char *readPageBuffer, uint32_t addr, uint32_t pageSize)
+{
+    // index of the page in the current statistics, for sampling
+    const uint32_t pageIndex = _verifyStats.nbrOfPagesWritten++;
+
+    int32_t err = UC_ERR_NONE;
+    bool isIdentical = true;
+    switch (_verifyMode) {
+        case VERIFY_DEFERRED:
+            return UC_ERR_NONE;
+
+        case VERIFY_SAMPLED:
+            if ((pageIndex % MBED_CONF_UPDATE_CLIENT_VERIFY_SAMPLE_INTERVAL) != 0) {
+                return UC_ERR_NONE;
+            }
+            err = compareWithFlash(writePageBuffer, addr, pageSize, isIdentical);
+            break;
+
+        case VERIFY_CRC:
+            err = compareCrcWithFlash(writePageBuffer, addr, pageSize, isIdentical);
+            break;
+
+        case VERIFY_READ_BACK:
+        default:
+            if (readPageBuffer == NULL) {
+                err = compareWithFlash(writePageBuffer, addr, pageSize, isIdentical);
+                break;
+            }
+            memset(readPageBuffer, 0, sizeof(char) * pageSize);
+            err = read(readPageBuffer, addr, pageSize);
+            if (0 != err) {
+                tr_error("Flash read failed: %" PRIi32 "", err);
+                return err;
+            }
+            isIdentical = (memcmp(writePageBuffer, readPageBuffer, pageSize) == 0);
+            break;
+    }
+    if (err != UC_ERR_NONE) {
+        return err;
+    }
+
+    _verifyStats.nbrOfPagesVerified++;
+    _verifyStats.nbrOfBytesVerified += pageSize;
+    if (! isIdentical) {
+        _verifyStats.nbrOfVerifyFailures++;
+        tr_error("Write and read differ");
+        return UC_ERR_WRITE_FAILED;
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t FlashUpdater::compareWithFlash(const char *pData, uint32_t addr, uint32_t size, bool &isIdentical)
+{
+    const uint8_t *pFlash = getFlashSpan(addr, size);
+    if (pFlash != NULL) {
+        isIdentical = (memcmp(pData, pFlash, size) == 0);
+        return UC_ERR_NONE;
+    }
+
+    // read the flash in small chunks
+    uint8_t chunk[kVerifyChunkSize];
+    isIdentical = true;
+    for (uint32_t offset = 0; offset < size && isIdentical; offset += kVerifyChunkSize) {
+        const uint32_t chunkSize = (size - offset < kVerifyChunkSize) ? (size - offset) : kVerifyChunkSize;
+        int err = read(chunk, addr + offset, chunkSize);
+        if (0 != err) {
+            tr_error("Flash read failed: %d", err);
+            return UC_ERR_READING_FLASH;
+        }
+        isIdentical = (memcmp(&pData[offset], chunk, chunkSize) == 0);
+    }
+
+    return UC_ERR_NONE;
+}
+
+int32_t FlashUpdater::compareCrcWithFlash(const char *pData, uint32_t addr, uint32_t size, bool &isIdentical)
+{
+    const uint32_t expectedCrc = crc32(reinterpret_cast<const uint8_t *>(pData), size);
+
+    uint32_t flashCrc = 0;
+    const uint8_t *pFlash = getFlashSpan(addr, size);
+    if (pFlash != NULL) {
+        flashCrc = crc32(pFlash, size);
+    } else {
+        uint8_t chunk[kVerifyChunkSize];
+        uint32_t crc = kCrc32Init;
+        for (uint32_t offset = 0; offset < size; offset += kVerifyChunkSize) {
+            const uint32_t chunkSize = (size - offset < kVerifyChunkSize) ? (size - offset) : kVerifyChunkSize;
+            int err = read(chunk, addr + offset, chunkSize);
+            if (0 != err) {
+                tr_error("Flash read failed: %d", err);
+                return UC_ERR_READING_FLASH;
+            }
+            crc = crc32Update(crc, chunk, chunkSize);
+        }
+        flashCrc = crc32Finish(crc);
+    }
+    isIdentical = (flashCrc == expectedCrc);
+
+    return UC_ERR_NONE;
+}
+
+void FlashUpdater::buildSectorIndex()
+{
+    _nbrOfSectorRuns = 0;
+    _flashStartAddress = get_flash_start();
+    _flashEndAddress = _flashStartAddress + get_flash_size();
+
+    // walk the sector map once and merge consecutive sectors of identical size
+    uint32_t nbrOfSectorRuns = 0;
+    uint32_t address = _flashStartAddress;
+    while (address < _flashEndAddress) {
+        const uint32_t sectorSize = get_sector_size(address);
+        if (sectorSize == 0) {
+            tr_error("Invalid sector size at address 0x%08" PRIx32 "", address);
+            return;
+        }
+
+        if (nbrOfSectorRuns > 0 && _sectorRuns[nbrOfSectorRuns - 1].sectorSize == sectorSize) {
+            _sectorRuns[nbrOfSectorRuns - 1].nbrOfSectors++;
+        } else {
+            if (nbrOfSectorRuns == kMaxSectorRuns) {
+                // keep walking the sector map on each request
+                tr_debug("Sector map has more than %" PRIu32 " runs, not indexed", kMaxSectorRuns);
+                return;
+            }
+            _sectorRuns[nbrOfSectorRuns].startAddress = address;
+            _sectorRuns[nbrOfSectorRuns].sectorSize = sectorSize;
+            _sectorRuns[nbrOfSectorRuns].nbrOfSectors = 1;
+            nbrOfSectorRuns++;
+        }
+        address += sectorSize;
+    }
+
+    _nbrOfSectorRuns = nbrOfSectorRuns;
+    tr_debug("Sector map indexed in %" PRIu32 " runs", _nbrOfSectorRuns);
+}
+
+const FlashUpdater::SectorRun *FlashUpdater::findSectorRun(uint32_t address) const
+{
+    // binary search of the last run starting at or before the address
+    uint32_t low = 0;
+    uint32_t high = _nbrOfSectorRuns - 1;
+    while (low < high) {
+        const uint32_t middle = (low + high + 1) / 2;
+        if (_sectorRuns[middle].startAddress <= address) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    return &_sectorRuns[low];
+}
+
 } // namespace update_client
 
 
@@ -1,23 +1,117 @@
 #pragma once
 
+#if (USE_SIMULATED_FLASH_UC == 1)
+#include <cinttypes>
+#include <cstring>
+#include "sim_flash_iap.hpp"
+// host builds have no mbed configuration
+#ifndef MBED_CONF_UPDATE_CLIENT_PROGRAM_VERIFY_MODE
+#define MBED_CONF_UPDATE_CLIENT_PROGRAM_VERIFY_MODE 0
+#endif
+#ifndef MBED_CONF_UPDATE_CLIENT_VERIFY_SAMPLE_INTERVAL
+#define MBED_CONF_UPDATE_CLIENT_VERIFY_SAMPLE_INTERVAL 8
+#endif
+#else
 #include "mbed.h"
+#endif // USE_SIMULATED_FLASH_UC
 
 namespace update_client {
 
+// on the host, the internal flash is replaced by a RAM backed simulation
+#if (USE_SIMULATED_FLASH_UC == 1)
+typedef SimFlashIAP FlashUpdaterBase;
+#else
+typedef FlashIAP FlashUpdaterBase;
+#endif // USE_SIMULATED_FLASH_UC
+
 // FlashUpdater is an extension of FlashIAP for dealing with application updates stored on the internal Flash
 
 class FlashUpdater :
-    public FlashIAP {
+    public FlashUpdaterBase {
 public:
+    // verification of the pages programmed by writePage
+    enum VerifyMode {
+        // read the whole page back and compare it
+        VERIFY_READ_BACK,
+        // compare the CRC of the page with the CRC of the flash content
+        VERIFY_CRC,
+        // read back one page in every MBED_CONF_UPDATE_CLIENT_VERIFY_SAMPLE_INTERVAL pages
+        VERIFY_SAMPLED,
+        // no verification while writing, the caller verifies the whole image by its digest
+        VERIFY_DEFERRED
+    };
+
+    // statistics accumulated by writePage since the last call to resetVerifyStats()
+    struct VerifyStats {
+        uint32_t nbrOfPagesWritten;
+        uint32_t nbrOfPagesVerified;
+        uint64_t nbrOfBytesVerified;
+        uint32_t nbrOfVerifyFailures;
+    };
+
     FlashUpdater();
 
+    // initialize the flash and build the index of the sector map
+    int init();
+
     // read a page from a specified address and update the address for reading from the next page
     int32_t readPage(uint32_t pageSize, char *readPageBuffer, uint32_t &addr);
     // write a page to a specified address and update the parameters for writing to the next page
+    // readPageBuffer may be NULL, in which case the page is verified without a second page buffer
     int32_t writePage(uint32_t pageSize, char *writePageBuffer, char *readPageBuffer,
                       uint32_t &addr, bool &sectorErased, size_t &pagesFlashed, uint32_t &nextSectorAddress);
+    // erase the sector starting at the address unless it is already erased
+    int32_t prepareSector(uint32_t address);
+    // program whole pages within erased sectors in a single call and verify them
+    // readPageBuffer may be NULL as for writePage
+    int32_t programPages(const char *pData, char *readPageBuffer, uint32_t addr, uint32_t size);
     // returns the address passed as parameter aligned to the flash sector
     uint32_t alignAddressToSector(uint32_t address, bool roundDown);
+    // returns the size of the sector containing the address
+    uint32_t getSectorSize(uint32_t address);
+    // returns the start address of the sector following the one containing the address
+    uint32_t getNextSectorAddress(uint32_t address);
+    // returns a pointer for reading the flash range in place, or NULL if the flash is not
+    // memory mapped or the range is out of bounds (the range must then be read with read())
+    const uint8_t *getFlashSpan(uint32_t address, uint32_t size);
+    // checks whether a range only holds the erase value
+    int32_t isErased(uint32_t address, uint32_t size, bool &erased);
+    // erase the sectors of a sector aligned range, skipping the sectors that are already erased
+    int32_t eraseRange(uint32_t address, uint32_t size, uint32_t &nbrOfSectorsErased);
+
+    // the verify mode applies to all pages written until it is changed
+    void setVerifyMode(VerifyMode verifyMode);
+    VerifyMode getVerifyMode() const;
+    const VerifyStats &getVerifyStats() const;
+    void resetVerifyStats();
+
+private:
+    // the sector map is indexed as runs of sectors of identical size, so that
+    // even flash with many small sectors only requires a few entries
+    struct SectorRun {
+        uint32_t startAddress;
+        uint32_t sectorSize;
+        uint32_t nbrOfSectors;
+    };
+
+    // private methods
+    void buildSectorIndex();
+    int32_t verifyPage(const char *writePageBuffer, char *readPageBuffer, uint32_t addr, uint32_t pageSize);
+    // compare data with the flash content without a page buffer
+    int32_t compareWithFlash(const char *pData, uint32_t addr, uint32_t size, bool &isIdentical);
+    int32_t compareCrcWithFlash(const char *pData, uint32_t addr, uint32_t size, bool &isIdentical);
+    const SectorRun *findSectorRun(uint32_t address) const;
+
+    // data members
+    static constexpr uint32_t kMaxSectorRuns = 16;
+    SectorRun _sectorRuns[kMaxSectorRuns];
+    // 0 if the index is not available (not initialized or too many runs)
+    uint32_t _nbrOfSectorRuns;
+    uint32_t _flashStartAddress;
+    uint32_t _flashEndAddress;
+    VerifyMode _verifyMode;
+    VerifyStats _verifyStats;
+    static constexpr uint32_t kVerifyChunkSize = 32;
 };
 
 } // namespace update_client
@@ -0,0 +1,277 @@
+#include "flash_writer_pipeline.hpp"
+#include "uc_arena.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "FlashWriterPipeline"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+FlashWriterPipeline::FlashWriterPipeline(FlashUpdater &flashUpdater, ApplicationDigest &digest) :
+    _flashUpdater(flashUpdater),
+    _digest(digest),
+    _writerStack(static_cast<unsigned char *>(UpdateClientArena::allocate(kWriterStackSize))),
+    _writerThread(osPriorityAboveNormal, kWriterStackSize, _writerStack, "FlashWriterThread"),
+    _pPendingBuffer(NULL),
+    _bufferCapacity(0),
+    _started(false),
+    _streamWriter(flashUpdater),
+    _startAddress(0),
+    _resumeOffset(0),
+    _resumeHashPending(false),
+    _nbrOfDeferredBytes(0),
+    _maxSize(0),
+    _programmedSize(0),
+    _pagesFlashed(0),
+    _result(UC_ERR_NONE)
+{
+    memset(_buffers, 0, sizeof(_buffers));
+    memset(&_endOfImage, 0, sizeof(_endOfImage));
+}
+
+FlashWriterPipeline::~FlashWriterPipeline()
+{
+    if (_started) {
+        finish();
+    }
+    for (uint32_t bufferIndex = 0; bufferIndex < kNbrOfBuffers; bufferIndex++) {
+        UpdateClientArena::release(_buffers[bufferIndex].pData);
+        _buffers[bufferIndex].pData = NULL;
+    }
+    // the writer thread was joined, so its stack is no longer used
+    UpdateClientArena::release(_writerStack);
+    _writerStack = NULL;
+}
+
+int32_t FlashWriterPipeline::start(uint32_t address, uint32_t deferredSize, uint32_t resumeOffset,
+                                   uint32_t maxSize)
+{
+    // buffers hold a whole number of pages, so that they are programmed without copies
+    const uint32_t pageSize = _flashUpdater.get_page_size();
+    _bufferCapacity = ((MBED_CONF_UPDATE_CLIENT_PIPELINE_BUFFER_SIZE + pageSize - 1) / pageSize) * pageSize;
+    tr_debug(" Using %" PRIu32 " buffers of %" PRIu32 " bytes", kNbrOfBuffers, _bufferCapacity);
+
+    for (uint32_t bufferIndex = 0; bufferIndex < kNbrOfBuffers; bufferIndex++) {
+        _buffers[bufferIndex].pData = static_cast<char *>(UpdateClientArena::allocate(_bufferCapacity));
+        _buffers[bufferIndex].size = 0;
+        _freeBuffers.try_put(&_buffers[bufferIndex]);
+    }
+
+    _startAddress = address;
+    _resumeOffset = resumeOffset;
+    _resumeHashPending = false;
+    _nbrOfDeferredBytes = 0;
+    _maxSize = maxSize;
+    _result = _streamWriter.start(address, deferredSize, resumeOffset, maxSize);
+    if (_result != UC_ERR_NONE) {
+        return _result;
+    }
+    _programmedSize = _streamWriter.getAddress() - _startAddress;
+    _pagesFlashed = 0;
+    if (resumeOffset > 0) {
+        if (deferredSize > 0) {
+            _resumeHashPending = true;
+        } else {
+            // the digest covers the whole image, including what was received before
+            _result = _digest.updateFromFlash(_flashUpdater, address, resumeOffset);
+            if (_result != UC_ERR_NONE) {
+                return _result;
+            }
+        }
+    }
+
+    osStatus status = _writerThread.start(callback(this, &FlashWriterPipeline::writeBuffers));
+    if (status != osOK) {
+        tr_error(" Cannot start flash writer thread: %d", status);
+        return UC_ERR_INVALID_PARAMETER;
+    }
+    _started = true;
+
+    return UC_ERR_NONE;
+}
+
+FlashWriterPipeline::Buffer *FlashWriterPipeline::getFreeBuffer()
+{
+    Buffer *pBuffer = NULL;
+    _freeBuffers.try_get_for(Kernel::wait_for_u32_forever, &pBuffer);
+    pBuffer->size = 0;
+
+    return pBuffer;
+}
+
+void FlashWriterPipeline::submitBuffer(Buffer *pBuffer)
+{
+    if (pBuffer->size == 0) {
+        // nothing to write, give the buffer back
+        _freeBuffers.try_put(pBuffer);
+        return;
+    }
+    _filledBuffers.try_put_for(Kernel::wait_for_u32_forever, pBuffer);
+}
+
+FlashWriterPipeline::Buffer *FlashWriterPipeline::getPendingBuffer()
+{
+    if (_pPendingBuffer == NULL) {
+        _pPendingBuffer = getFreeBuffer();
+    }
+
+    return _pPendingBuffer;
+}
+
+void FlashWriterPipeline::commitPendingData(uint32_t size)
+{
+    _pPendingBuffer->size += size;
+    if (_pPendingBuffer->size == _bufferCapacity) {
+        submitBuffer(_pPendingBuffer);
+        _pPendingBuffer = NULL;
+    }
+}
+
+void FlashWriterPipeline::append(const char *pData, uint32_t size)
+{
+    while (size > 0) {
+        Buffer *pBuffer = getPendingBuffer();
+        const uint32_t copySize = (size < _bufferCapacity - pBuffer->size) ? size : (_bufferCapacity - pBuffer->size);
+        memcpy(&pBuffer->pData[pBuffer->size], pData, copySize);
+        pData += copySize;
+        size -= copySize;
+        commitPendingData(copySize);
+    }
+}
+
+int32_t FlashWriterPipeline::finish()
+{
+    if (! _started) {
+        return _result;
+    }
+
+    // write the last partial buffer
+    if (_pPendingBuffer != NULL) {
+        submitBuffer(_pPendingBuffer);
+        _pPendingBuffer = NULL;
+    }
+
+    // the end of image marker is queued after all submitted buffers
+    _filledBuffers.try_put_for(Kernel::wait_for_u32_forever, &_endOfImage);
+    _writerThread.join();
+    _started = false;
+
+    tr_debug(" Flash writer programmed %" PRIu32 " pages", (uint32_t) _streamWriter.getPagesFlashed());
+    return _result;
+}
+
+int32_t FlashWriterPipeline::commitDeferredData()
+{
+    if (_started || _result != UC_ERR_NONE) {
+        return (_result != UC_ERR_NONE) ? _result : UC_ERR_INVALID_PARAMETER;
+    }
+
+    const int32_t result = _streamWriter.commitDeferredData();
+    _pagesFlashed = _streamWriter.getPagesFlashed();
+    return result;
+}
+
+const char *FlashWriterPipeline::getDeferredData(uint32_t &size) const
+{
+    return _streamWriter.getDeferredData(size);
+}
+
+int32_t FlashWriterPipeline::getResult() const
+{
+    return core_util_atomic_load_s32(&_result);
+}
+
+uint32_t FlashWriterPipeline::getBufferCapacity() const
+{
+    return _bufferCapacity;
+}
+
+size_t FlashWriterPipeline::getPagesFlashed() const
+{
+    return core_util_atomic_load_u32(&_pagesFlashed);
+}
+
+uint32_t FlashWriterPipeline::getProgrammedSize() const
+{
+    return core_util_atomic_load_u32(&_programmedSize);
+}
+
+void FlashWriterPipeline::writeBuffers()
+{
+    while (true) {
+        Buffer *pBuffer = NULL;
+        _filledBuffers.try_get_for(Kernel::wait_for_u32_forever, &pBuffer);
+        if (pBuffer == &_endOfImage) {
+            // pad and write the last page of the image
+            if (_result == UC_ERR_NONE) {
+                _result = _streamWriter.flush();
+                core_util_atomic_store_u32(&_pagesFlashed, _streamWriter.getPagesFlashed());
+            }
+            break;
+        }
+
+        // after an error, buffers are only recycled so that the receiver does not block
+        if (_result == UC_ERR_NONE) {
+            _result = writeBuffer(*pBuffer);
+            core_util_atomic_store_u32(&_programmedSize, _streamWriter.getAddress() - _startAddress);
+            core_util_atomic_store_u32(&_pagesFlashed, _streamWriter.getPagesFlashed());
+        }
+        _freeBuffers.try_put(pBuffer);
+    }
+}
+
+int32_t FlashWriterPipeline::writeBuffer(Buffer &buffer)
+{
+    const char *pData = buffer.pData;
+    uint32_t size = buffer.size;
+    if (_resumeHashPending) {
+        // a resumed image starts with the deferred data, followed by the data from the resume offset
+        uint32_t deferredSize = 0;
+        _streamWriter.getDeferredData(deferredSize);
+        const uint32_t writeSize = (size < deferredSize - _nbrOfDeferredBytes) ? size : (deferredSize - _nbrOfDeferredBytes);
+        int32_t result = writeData(pData, writeSize);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+        pData += writeSize;
+        size -= writeSize;
+        _nbrOfDeferredBytes += writeSize;
+        if (_nbrOfDeferredBytes < deferredSize) {
+            return UC_ERR_NONE;
+        }
+
+        // the digest covers the whole image, including what was received before
+        _resumeHashPending = false;
+        result = _digest.updateFromFlash(_flashUpdater, _startAddress + deferredSize, _resumeOffset - deferredSize);
+        if (result != UC_ERR_NONE) {
+            return result;
+        }
+    }
+
+    return writeData(pData, size);
+}
+
+int32_t FlashWriterPipeline::writeData(const char *pData, uint32_t size)
+{
+    int32_t result = _streamWriter.append(pData, size);
+    if (result != UC_ERR_NONE) {
+        return result;
+    }
+
+    // with a full verification, the pages were verified, so the digest reflects the flash content
+    // (a partial last page is only written by flush(), where it is verified as well). Otherwise
+    // the image is hashed from flash before its header is committed
+    _digest.update(reinterpret_cast<const uint8_t *>(pData), size);
+
+    // an image announcing more than the area holds is rejected as soon as its header is known
+    if (_maxSize > 0 && _digest.getImageSize() > _maxSize) {
+        tr_error(" Image of %" PRIu64 " bytes exceeds its area of %" PRIu32 " bytes", _digest.getImageSize(), _maxSize);
+        return UC_ERR_IMAGE_TOO_LARGE;
+    }
+
+    return UC_ERR_NONE;
+}
+
+} // namespace update_client
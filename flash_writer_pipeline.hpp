@@ -0,0 +1,95 @@
+#pragma once
+
+#include "mbed.h"
+
+#include "application_digest.hpp"
+#include "flash_stream_writer.hpp"
+#include "flash_updater.hpp"
+
+namespace update_client {
+
+// FlashWriterPipeline decouples the reception of an image from its programming in flash
+// The receiver fills buffers and submits them to a flash writer thread, which programs them
+// while the next buffers are being received. When all buffers are in use, the receiver
+// blocks in getFreeBuffer() until the flash writer catches up. Receivers that produce data
+// in pieces fill the pending buffer in place, which is submitted once full
+
+class FlashWriterPipeline {
+public:
+    struct Buffer {
+        char *pData;
+        uint32_t size;
+    };
+
+    // constructor
+    FlashWriterPipeline(FlashUpdater &flashUpdater, ApplicationDigest &digest);
+    ~FlashWriterPipeline();
+
+    // start the flash writer thread, the image is written from the given sector aligned address
+    // (the first deferredSize bytes are only programmed by commitDeferredData()). An image
+    // programmed up to resumeOffset is completed with the data from there, which is preceded
+    // by the deferred bytes if any. The digest is fed with the programmed data. If maxSize is
+    // not 0, the image fails as soon as its header or its data exceed maxSize bytes
+    int32_t start(uint32_t address, uint32_t deferredSize = 0, uint32_t resumeOffset = 0,
+                  uint32_t maxSize = 0);
+    // get an empty buffer, blocks until one is available
+    Buffer *getFreeBuffer();
+    // hand a buffer to the flash writer, buffers may be partially filled
+    void submitBuffer(Buffer *pBuffer);
+    // get the buffer being filled, blocks until one is available
+    Buffer *getPendingBuffer();
+    // account for size bytes written at the end of the pending buffer, submits it when full
+    void commitPendingData(uint32_t size);
+    // copy data into pending buffers
+    void append(const char *pData, uint32_t size);
+    // wait until all submitted buffers are written and stop the flash writer thread
+    int32_t finish();
+    // once finished, program the deferred data (the header of the image)
+    int32_t commitDeferredData();
+    const char *getDeferredData(uint32_t &size) const;
+
+    // result of the flash writer so far, can be called while the flash writer is running
+    int32_t getResult() const;
+    uint32_t getBufferCapacity() const;
+    // can be called while the flash writer is running
+    size_t getPagesFlashed() const;
+    // number of bytes from the start address that are programmed (and verified unless deferred),
+    // counting the deferred data although it is programmed last, can be called while the flash
+    // writer is running
+    uint32_t getProgrammedSize() const;
+
+private:
+    // private methods
+    void writeBuffers();
+    int32_t writeBuffer(Buffer &buffer);
+    int32_t writeData(const char *pData, uint32_t size);
+
+    // data members
+    FlashUpdater &_flashUpdater;
+    ApplicationDigest &_digest;
+    static constexpr uint32_t kWriterStackSize = OS_STACK_SIZE;
+    unsigned char *_writerStack;
+    Thread _writerThread;
+    static constexpr uint32_t kNbrOfBuffers = MBED_CONF_UPDATE_CLIENT_PIPELINE_BUFFER_COUNT;
+    Buffer _buffers[kNbrOfBuffers];
+    Buffer _endOfImage;
+    Queue<Buffer, kNbrOfBuffers> _freeBuffers;
+    Queue<Buffer, kNbrOfBuffers + 1> _filledBuffers;
+    Buffer *_pPendingBuffer;
+    uint32_t _bufferCapacity;
+    bool _started;
+
+    // state of the flash writer
+    FlashStreamWriter _streamWriter;
+    uint32_t _startAddress;
+    uint32_t _resumeOffset;
+    // the programmed data is hashed once the deferred data preceding it is received
+    bool _resumeHashPending;
+    uint32_t _nbrOfDeferredBytes;
+    uint32_t _maxSize;
+    volatile uint32_t _programmedSize;
+    volatile uint32_t _pagesFlashed;
+    volatile int32_t _result;
+};
+
+} // namespace update_client
@@ -0,0 +1,155 @@
+#include "frame_protocol.hpp"
+#include "uc_arena.hpp"
+#include "uc_crc32.hpp"
+#include "uc_error_codes.hpp"
+
+#include <cstring>
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "FrameProtocol"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+FrameProtocol::FrameProtocol(Transport &transport, uint32_t maxPayloadSize) :
+    _transport(transport),
+    _maxPayloadSize(maxPayloadSize),
+    // room for a complete frame after a partial one
+    _bufferSize(2 * (kHeaderSize + maxPayloadSize + kCrcSize)),
+    _pBuffer(static_cast<uint8_t *>(UpdateClientArena::allocate(_bufferSize))),
+    _start(0),
+    _end(0),
+    _nbrOfCorruptFrames(0)
+{
+
+}
+
+FrameProtocol::~FrameProtocol()
+{
+    UpdateClientArena::release(_pBuffer);
+    _pBuffer = NULL;
+}
+
+int32_t FrameProtocol::receiveFrame(Frame &frame, uint32_t timeoutMs)
+{
+    while (true) {
+        // skip anything before the next sync byte
+        while (_start < _end && _pBuffer[_start] != kSyncByte) {
+            _start++;
+        }
+
+        // wait for the header
+        if (_end - _start < kHeaderSize) {
+            int32_t result = fill(timeoutMs);
+            if (result != UC_ERR_NONE) {
+                return result;
+            }
+            continue;
+        }
+        const uint8_t *pFrame = &_pBuffer[_start];
+        const uint16_t length = (uint16_t)(pFrame[2] | (pFrame[3] << 8));
+        if (length > _maxPayloadSize) {
+            // not a frame, resynchronize
+            _nbrOfCorruptFrames++;
+            discard(1);
+            continue;
+        }
+
+        // wait for the payload and the CRC
+        const uint32_t frameSize = kHeaderSize + length + kCrcSize;
+        if (_end - _start < frameSize) {
+            int32_t result = fill(timeoutMs);
+            if (result != UC_ERR_NONE) {
+                return result;
+            }
+            continue;
+        }
+        pFrame = &_pBuffer[_start];
+        const uint32_t crc = crc32(&pFrame[1], kHeaderSize - 1 + length);
+        if (crc != parseUint32(&pFrame[kHeaderSize + length])) {
+            _nbrOfCorruptFrames++;
+            discard(1);
+            continue;
+        }
+
+        frame.type = pFrame[1];
+        frame.length = length;
+        frame.sequence = parseUint32(&pFrame[4]);
+        frame.pPayload = &pFrame[kHeaderSize];
+        discard(frameSize);
+        return UC_ERR_NONE;
+    }
+}
+
+int32_t FrameProtocol::sendFrame(uint8_t type, uint32_t sequence, const uint8_t *pPayload, uint16_t length)
+{
+    // only small control frames are sent by the device
+    if (length > kMaxControlPayloadSize) {
+        return UC_ERR_INVALID_PARAMETER;
+    }
+
+    uint8_t frame[kHeaderSize + kMaxControlPayloadSize + kCrcSize];
+    frame[0] = kSyncByte;
+    frame[1] = type;
+    frame[2] = (uint8_t)(length & 0xFF);
+    frame[3] = (uint8_t)(length >> 8);
+    writeUint32(&frame[4], sequence);
+    if (length > 0) {
+        memcpy(&frame[kHeaderSize], pPayload, length);
+    }
+    writeUint32(&frame[kHeaderSize + length], crc32(&frame[1], kHeaderSize - 1 + length));
+
+    return _transport.write(frame, kHeaderSize + length + kCrcSize);
+}
+
+uint32_t FrameProtocol::getMaxPayloadSize() const
+{
+    return _maxPayloadSize;
+}
+
+uint32_t FrameProtocol::getNbrOfCorruptFrames() const
+{
+    return _nbrOfCorruptFrames;
+}
+
+uint32_t FrameProtocol::parseUint32(const uint8_t *pBuffer)
+{
+    return (uint32_t) pBuffer[0] | ((uint32_t) pBuffer[1] << 8) |
+           ((uint32_t) pBuffer[2] << 16) | ((uint32_t) pBuffer[3] << 24);
+}
+
+void FrameProtocol::writeUint32(uint8_t *pBuffer, uint32_t value)
+{
+    pBuffer[0] = (uint8_t)(value & 0xFF);
+    pBuffer[1] = (uint8_t)((value >> 8) & 0xFF);
+    pBuffer[2] = (uint8_t)((value >> 16) & 0xFF);
+    pBuffer[3] = (uint8_t)((value >> 24) & 0xFF);
+}
+
+int32_t FrameProtocol::fill(uint32_t timeoutMs)
+{
+    // move the pending bytes to the start of the buffer
+    if (_start > 0) {
+        memmove(_pBuffer, &_pBuffer[_start], _end - _start);
+        _end -= _start;
+        _start = 0;
+    }
+
+    uint32_t nbrOfBytesRead = 0;
+    int32_t result = _transport.read(&_pBuffer[_end], _bufferSize - _end, timeoutMs, nbrOfBytesRead);
+    _end += nbrOfBytesRead;
+
+    return result;
+}
+
+void FrameProtocol::discard(uint32_t size)
+{
+    _start += size;
+    if (_start == _end) {
+        _start = 0;
+        _end = 0;
+    }
+}
+
+} // namespace update_client
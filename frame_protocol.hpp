@@ -0,0 +1,95 @@
+#pragma once
+
+#include "uc_transport.hpp"
+
+namespace update_client {
+
+// FrameProtocol exchanges frames over a transport
+// A frame is made of (all fields little endian):
+//   sync (1 byte, 0xA5) | type (1 byte) | length (2 bytes) | sequence (4 bytes) |
+//   payload (length bytes) | CRC-32 of type, length, sequence and payload (4 bytes)
+// Frames with an invalid CRC are skipped and the receiver resynchronizes on the next sync byte
+//
+// An update is transferred as follows:
+//   host   -> HELLO (image id, image size, optional flags), control payloads are made of 32 bit fields
+//   device -> HELLO_ACK (resume offset, max payload size, window size, header resend size)
+//             If the header resend size is not 0, the header of the image is programmed last
+//             and was lost with the interruption: the host first sends the image from offset
+//             0 up to this size, then continues from the resume offset
+//   host   -> DATA frames with consecutive sequence numbers starting at 0, each carrying the
+//             image offset of its data (4 bytes) followed by the data. Up to window size frames
+//             may be outstanding
+//   device -> ACK (next expected sequence, next image offset) every half window and after
+//             a timeout, NAK (expected sequence) on a gap. The host then resends from there
+//   host   -> END (sequence of the frame after the last DATA frame)
+//   device -> RESULT (UC_ERR_* code of the validation of the image)
+
+class FrameProtocol {
+public:
+    enum FrameType {
+        FRAME_HELLO = 1,
+        FRAME_HELLO_ACK = 2,
+        FRAME_DATA = 3,
+        FRAME_ACK = 4,
+        FRAME_NAK = 5,
+        FRAME_END = 6,
+        FRAME_RESULT = 7
+    };
+
+    // flags of the HELLO frame
+    enum HelloFlags {
+        // the image is compressed with heatshrink
+        // (compressed images and patches cannot be resumed)
+        HELLO_FLAG_COMPRESSED = 0x01,
+        // the image is a patch against the active application (see DeltaPatcher), applied
+        // after decompression
+        HELLO_FLAG_DELTA = 0x02
+    };
+
+    struct Frame {
+        uint8_t type;
+        uint16_t length;
+        uint32_t sequence;
+        // valid until the next frame is received
+        const uint8_t *pPayload;
+    };
+
+    static constexpr uint8_t kSyncByte = 0xA5;
+    static constexpr uint32_t kHeaderSize = 8;
+    static constexpr uint32_t kCrcSize = 4;
+
+    // constructor
+    FrameProtocol(Transport &transport, uint32_t maxPayloadSize);
+    ~FrameProtocol();
+
+    // receive the next frame with a valid CRC
+    int32_t receiveFrame(Frame &frame, uint32_t timeoutMs);
+    int32_t sendFrame(uint8_t type, uint32_t sequence, const uint8_t *pPayload, uint16_t length);
+
+    uint32_t getMaxPayloadSize() const;
+    uint32_t getNbrOfCorruptFrames() const;
+
+    static uint32_t parseUint32(const uint8_t *pBuffer);
+    static void writeUint32(uint8_t *pBuffer, uint32_t value);
+
+private:
+    // read more data from the transport at the end of the buffer
+    int32_t fill(uint32_t timeoutMs);
+    void discard(uint32_t size);
+
+    // not copyable
+    FrameProtocol(const FrameProtocol &);
+    FrameProtocol &operator=(const FrameProtocol &);
+
+    // data members
+    Transport &_transport;
+    const uint32_t _maxPayloadSize;
+    const uint32_t _bufferSize;
+    uint8_t *_pBuffer;
+    uint32_t _start;
+    uint32_t _end;
+    uint32_t _nbrOfCorruptFrames;
+    static constexpr uint32_t kMaxControlPayloadSize = 16;
+};
+
+} // namespace update_client
@@ -0,0 +1,131 @@
+#include "heatshrink_decoder.hpp"
+#include "uc_arena.hpp"
+
+#include <cstring>
+
+namespace update_client {
+
+HeatshrinkDecoder::HeatshrinkDecoder(uint8_t windowBits, uint8_t lookaheadBits) :
+    _windowBits(windowBits),
+    _lookaheadBits(lookaheadBits),
+    _windowMask((uint16_t)((1U << windowBits) - 1)),
+    _pWindow(static_cast<uint8_t *>(UpdateClientArena::allocate(1U << windowBits))),
+    _headIndex(0),
+    _state(STATE_TAG_BIT),
+    _currentByte(0),
+    _bitMask(0),
+    _fieldValue(0),
+    _fieldBits(0),
+    _backrefOffset(0),
+    _backrefCount(0)
+{
+    reset();
+}
+
+HeatshrinkDecoder::~HeatshrinkDecoder()
+{
+    UpdateClientArena::release(_pWindow);
+    _pWindow = NULL;
+}
+
+void HeatshrinkDecoder::reset()
+{
+    // back references before the start of the stream read zeros
+    memset(_pWindow, 0, getWindowSize());
+    _headIndex = 0;
+    _state = STATE_TAG_BIT;
+    _currentByte = 0;
+    _bitMask = 0;
+    _fieldValue = 0;
+    _fieldBits = 0;
+    _backrefOffset = 0;
+    _backrefCount = 0;
+}
+
+void HeatshrinkDecoder::decode(const uint8_t *pInput, uint32_t inputSize, uint32_t &nbrOfBytesConsumed,
+                               uint8_t *pOutput, uint32_t outputSize, uint32_t &nbrOfBytesProduced)
+{
+    uint32_t inputIndex = 0;
+    uint32_t outputIndex = 0;
+    uint16_t value = 0;
+    while (outputIndex < outputSize) {
+        if (_state == STATE_TAG_BIT) {
+            if (! readBits(1, pInput, inputSize, inputIndex, value)) {
+                break;
+            }
+            _state = (value != 0) ? STATE_LITERAL : STATE_BACKREF_INDEX;
+        } else if (_state == STATE_LITERAL) {
+            if (! readBits(8, pInput, inputSize, inputIndex, value)) {
+                break;
+            }
+            outputByte((uint8_t) value, pOutput, outputIndex);
+            _state = STATE_TAG_BIT;
+        } else if (_state == STATE_BACKREF_INDEX) {
+            if (! readBits(_windowBits, pInput, inputSize, inputIndex, value)) {
+                break;
+            }
+            _backrefOffset = value + 1;
+            _state = STATE_BACKREF_COUNT;
+        } else if (_state == STATE_BACKREF_COUNT) {
+            if (! readBits(_lookaheadBits, pInput, inputSize, inputIndex, value)) {
+                break;
+            }
+            _backrefCount = value + 1;
+            _state = STATE_YIELD_BACKREF;
+        } else {
+            // copy from the window as much as the output allows
+            while (_backrefCount > 0 && outputIndex < outputSize) {
+                outputByte(_pWindow[(uint16_t)(_headIndex - _backrefOffset) & _windowMask], pOutput, outputIndex);
+                _backrefCount--;
+            }
+            if (_backrefCount == 0) {
+                _state = STATE_TAG_BIT;
+            }
+        }
+    }
+
+    nbrOfBytesConsumed = inputIndex;
+    nbrOfBytesProduced = outputIndex;
+}
+
+bool HeatshrinkDecoder::needsInput() const
+{
+    return _state != STATE_YIELD_BACKREF;
+}
+
+uint32_t HeatshrinkDecoder::getWindowSize() const
+{
+    return 1U << _windowBits;
+}
+
+bool HeatshrinkDecoder::readBits(uint8_t count, const uint8_t *pInput, uint32_t inputSize,
+                                 uint32_t &inputIndex, uint16_t &value)
+{
+    // bits are read MSB first
+    while (_fieldBits < count) {
+        if (_bitMask == 0) {
+            if (inputIndex == inputSize) {
+                return false;
+            }
+            _currentByte = pInput[inputIndex++];
+            _bitMask = 0x80;
+        }
+        _fieldValue = (uint16_t)((_fieldValue << 1) | ((_currentByte & _bitMask) ? 1 : 0));
+        _bitMask >>= 1;
+        _fieldBits++;
+    }
+
+    value = _fieldValue;
+    _fieldValue = 0;
+    _fieldBits = 0;
+    return true;
+}
+
+void HeatshrinkDecoder::outputByte(uint8_t byte, uint8_t *pOutput, uint32_t &outputIndex)
+{
+    pOutput[outputIndex++] = byte;
+    _pWindow[_headIndex & _windowMask] = byte;
+    _headIndex++;
+}
+
+} // namespace update_client
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+namespace update_client {
+
+// HeatshrinkDecoder decompresses a stream in the heatshrink format (LZSS with a bit level
+// encoding), as produced by "heatshrink -e -w <windowBits> -l <lookaheadBits>"
+// The RAM cost is a window of 2^windowBits bytes plus the decoder state, independently
+// of the size of the image. Input and output can be split at any byte boundary
+
+class HeatshrinkDecoder {
+public:
+    // constructor, the window is allocated from the update client arena
+    HeatshrinkDecoder(uint8_t windowBits, uint8_t lookaheadBits);
+    ~HeatshrinkDecoder();
+
+    // restart the decoder for a new stream
+    void reset();
+    // decode input into output until the input is consumed or the output is full
+    // returns the number of input bytes consumed and output bytes produced
+    void decode(const uint8_t *pInput, uint32_t inputSize, uint32_t &nbrOfBytesConsumed,
+                uint8_t *pOutput, uint32_t outputSize, uint32_t &nbrOfBytesProduced);
+    // returns true if decoding is waiting for input (all decoded bytes have been produced)
+    bool needsInput() const;
+
+    uint32_t getWindowSize() const;
+
+private:
+    enum State {
+        STATE_TAG_BIT,
+        STATE_LITERAL,
+        STATE_BACKREF_INDEX,
+        STATE_BACKREF_COUNT,
+        STATE_YIELD_BACKREF
+    };
+
+    // read a field of count bits, possibly across calls, returns false if the input is exhausted
+    bool readBits(uint8_t count, const uint8_t *pInput, uint32_t inputSize, uint32_t &inputIndex, uint16_t &value);
+    void outputByte(uint8_t byte, uint8_t *pOutput, uint32_t &outputIndex);
+
+    // not copyable
+    HeatshrinkDecoder(const HeatshrinkDecoder &);
+    HeatshrinkDecoder &operator=(const HeatshrinkDecoder &);
+
+    // data members
+    const uint8_t _windowBits;
+    const uint8_t _lookaheadBits;
+    const uint16_t _windowMask;
+    uint8_t *_pWindow;
+    uint16_t _headIndex;
+    State _state;
+    // bit reader
+    uint8_t _currentByte;
+    uint8_t _bitMask;
+    uint16_t _fieldValue;
+    uint8_t _fieldBits;
+    // current back reference
+    uint16_t _backrefOffset;
+    uint16_t _backrefCount;
+};
+
+} // namespace update_client
@@ -0,0 +1,61 @@
+#include "install_journal.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "InstallJournal"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+InstallJournal::InstallJournal(FlashRecordLog &recordLog) :
+    _recordLog(recordLog)
+{
+
+}
+
+uint32_t InstallJournal::getResumeOffset(uint32_t destHeaderAddress, uint32_t sourceAddress, uint32_t headerCrc,
+                                         uint32_t copySize)
+{
+    FlashRecordLog::Record record;
+    if (_recordLog.find(kInstallRecordType, destHeaderAddress, record) != UC_ERR_NONE) {
+        return 0;
+    }
+    if (record.values[0] != sourceAddress || record.values[1] != headerCrc ||
+            record.values[2] != copySize || record.values[3] > copySize) {
+        // the journal describes the installation of another candidate
+        return 0;
+    }
+
+    return record.values[3];
+}
+
+bool InstallJournal::isInProgress(uint32_t destHeaderAddress, uint32_t &sourceAddress)
+{
+    FlashRecordLog::Record record;
+    if (_recordLog.find(kInstallRecordType, destHeaderAddress, record) != UC_ERR_NONE) {
+        return false;
+    }
+    sourceAddress = record.values[0];
+
+    return true;
+}
+
+int32_t InstallJournal::setCompletedSize(uint32_t destHeaderAddress, uint32_t sourceAddress, uint32_t headerCrc,
+                                         uint32_t copySize, uint32_t completedSize)
+{
+    const uint32_t values[FlashRecordLog::kNbrOfValues] = {
+        sourceAddress,
+        headerCrc,
+        copySize,
+        completedSize
+    };
+    return _recordLog.write(kInstallRecordType, destHeaderAddress, values);
+}
+
+int32_t InstallJournal::clear(uint32_t destHeaderAddress)
+{
+    return _recordLog.remove(kInstallRecordType, destHeaderAddress);
+}
+
+} // namespace update_client
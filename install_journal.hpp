@@ -0,0 +1,36 @@
+#pragma once
+
+#include "flash_record_log.hpp"
+
+namespace update_client {
+
+// InstallJournal records how much of a candidate has been copied to the active application,
+// so that an installation interrupted by a power loss resumes from the first incomplete
+// destination sector instead of from the first one. Entries are keyed on the destination
+// header address and identify the copy by the source address, the header CRC of the
+// candidate and the copy size. The completed size is always sector aligned and only covers
+// sectors that were programmed and verified
+
+class InstallJournal {
+public:
+    // constructor
+    explicit InstallJournal(FlashRecordLog &recordLog);
+
+    // returns the number of bytes already installed, 0 if no such installation was started
+    uint32_t getResumeOffset(uint32_t destHeaderAddress, uint32_t sourceAddress, uint32_t headerCrc, uint32_t copySize);
+    // returns true if an installation to the destination was interrupted, with its source address
+    bool isInProgress(uint32_t destHeaderAddress, uint32_t &sourceAddress);
+    int32_t setCompletedSize(uint32_t destHeaderAddress, uint32_t sourceAddress, uint32_t headerCrc,
+                             uint32_t copySize, uint32_t completedSize);
+    // must be called once the installation is complete
+    int32_t clear(uint32_t destHeaderAddress);
+
+private:
+    // data members
+    FlashRecordLog &_recordLog;
+
+    // record types are unique among the users of the log
+    static constexpr uint16_t kInstallRecordType = 3;
+};
+
+} // namespace update_client
@@ -0,0 +1,205 @@
+#include "integrity_scrubber.hpp"
+#include "candidate_applications.hpp"
+#include "flash_record_log.hpp"
+#include "uc_error_codes.hpp"
+#include "verification_cache.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "IntegrityScrubber"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+IntegrityScrubber::IntegrityScrubber() :
+    _scrubberThread(osPriorityLow, OS_STACK_SIZE, nullptr, "ScrubberThread"),
+    _nbrOfPauses(0)
+{
+    for (uint32_t resultIndex = 0; resultIndex < kNbrOfResults; resultIndex++) {
+        _results[resultIndex].headerCrc = 0;
+        _results[resultIndex].result = UC_ERR_NOT_FOUND;
+        _results[resultIndex].nbrOfChecks = 0;
+    }
+}
+
+void IntegrityScrubber::start()
+{
+    _events.clear(STOP_EVENT_FLAG);
+    _scrubberThread.start(callback(this, &IntegrityScrubber::run));
+}
+
+void IntegrityScrubber::stop()
+{
+    // wakes up the scrubber whether it sleeps or waits for the end of an update session
+    _events.set(STOP_EVENT_FLAG);
+    _scrubberThread.join();
+}
+
+void IntegrityScrubber::pause()
+{
+    _mutex.lock();
+    core_util_atomic_incr_u32(&_nbrOfPauses, 1);
+}
+
+void IntegrityScrubber::resume()
+{
+    _mutex.unlock();
+}
+
+void IntegrityScrubber::getSlotResult(uint32_t slotIndex, ScrubResult &scrubResult) const
+{
+    CriticalSectionLock lock;
+    scrubResult = _results[slotIndex];
+}
+
+void IntegrityScrubber::getActiveApplicationResult(ScrubResult &scrubResult) const
+{
+    CriticalSectionLock lock;
+    scrubResult = _results[kNbrOfResults - 1];
+}
+
+void IntegrityScrubber::run()
+{
+    int err = _flashUpdater.init();
+    if (0 != err) {
+        tr_error("Init flash failed: %d", err);
+        return;
+    }
+
+#if defined(POST_APPLICATION_ADDR)
+    const uint32_t headerSize = POST_APPLICATION_ADDR - HEADER_ADDR;
+#else
+    const uint32_t headerSize = APPLICATION_ADDR - HEADER_ADDR;
+#endif
+    // the slot layout does not change, the candidate applications are not allocated from the
+    // arena so that update sessions are not disturbed
+    uint32_t headerAddresses[kNbrOfResults] = { 0 };
+    bool hasSlot[kNbrOfResults] = { false };
+    {
+        CandidateApplications candidateApplications(_flashUpdater,
+                                                    MBED_CONF_UPDATE_CLIENT_STORAGE_ADDRESS,
+                                                    MBED_CONF_UPDATE_CLIENT_STORAGE_SIZE,
+                                                    headerSize,
+                                                    MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS);
+        for (uint32_t slotIndex = 0; slotIndex < kNbrOfResults - 1; slotIndex++) {
+            uint32_t slotSize = 0;
+            hasSlot[slotIndex] = (candidateApplications.getCandidateAddress(slotIndex, headerAddresses[slotIndex],
+                                                                             slotSize) == UC_ERR_NONE);
+        }
+    }
+    headerAddresses[kNbrOfResults - 1] = HEADER_ADDR;
+    hasSlot[kNbrOfResults - 1] = true;
+
+    bool isRunning = true;
+    while (isRunning) {
+        tr_debug("Starting integrity check of the applications");
+        for (uint32_t resultIndex = 0; resultIndex < kNbrOfResults && isRunning; resultIndex++) {
+            if (hasSlot[resultIndex]) {
+                isRunning = scrubApplication(resultIndex, headerAddresses[resultIndex],
+                                             headerAddresses[resultIndex] + headerSize);
+            }
+        }
+        isRunning = isRunning && sleepFor(kPeriodMs);
+    }
+
+    _flashUpdater.deinit();
+    tr_debug("Exiting integrity scrubber");
+}
+
+bool IntegrityScrubber::scrubApplication(uint32_t resultIndex, uint32_t headerAddress, uint32_t applicationAddress)
+{
+    MbedApplication application(_flashUpdater, headerAddress, applicationAddress);
+    MbedApplication::CheckState checkState;
+    bool isStarted = false;
+    bool isComplete = false;
+    uint32_t nbrOfPauses = 0;
+    int32_t result = UC_ERR_NONE;
+    while (! isComplete) {
+        _mutex.lock();
+        const uint64_t startTime = Kernel::get_ms_count();
+
+        // the flash may have been rewritten by an update session, start again
+        if (isStarted && nbrOfPauses != core_util_atomic_load_u32(&_nbrOfPauses)) {
+            application.abortCheck(checkState);
+            isStarted = false;
+        }
+        if (! isStarted) {
+            nbrOfPauses = core_util_atomic_load_u32(&_nbrOfPauses);
+            result = application.startCheck(checkState);
+            isStarted = true;
+            isComplete = (result != UC_ERR_NONE);
+        } else {
+            result = application.continueCheck(checkState, kChunkSize, isComplete);
+        }
+
+        const uint32_t busyTimeMs = (uint32_t)(Kernel::get_ms_count() - startTime);
+        _mutex.unlock();
+
+        // sleep long enough for the CPU budget, and at least one tick so that threads of
+        // equal priority run
+        if (! sleepFor((busyTimeMs * (100 - kCpuBudget)) / kCpuBudget + 1)) {
+            if (isStarted && ! isComplete) {
+                application.abortCheck(checkState);
+            }
+            return false;
+        }
+    }
+
+    setResult(resultIndex, checkState.headerCrc, result);
+    // only hashed applications are recorded, not those without a valid header
+    if (result == UC_ERR_NONE || result == UC_ERR_HASH_INVALID) {
+        recordResult(headerAddress, checkState.headerCrc, application.getFirmwareVersion(), result, nbrOfPauses);
+    }
+    if (result == UC_ERR_NONE) {
+        tr_debug(" Application at address 0x%08" PRIx32 " is valid", headerAddress);
+    } else {
+        tr_debug(" Application at address 0x%08" PRIx32 " is not valid: %" PRIi32 "", headerAddress, result);
+    }
+
+    return true;
+}
+
+void IntegrityScrubber::recordResult(uint32_t headerAddress, uint32_t headerCrc, uint64_t firmwareVersion,
+                                     int32_t result, uint32_t nbrOfPauses)
+{
+    if (MBED_CONF_UPDATE_CLIENT_METADATA_SIZE == 0) {
+        return;
+    }
+
+    _mutex.lock();
+    // the application may have been rewritten by an update session since it was hashed
+    if (nbrOfPauses == core_util_atomic_load_u32(&_nbrOfPauses)) {
+        // the log is read again, as an update session may have written to it
+        FlashRecordLog recordLog(_flashUpdater,
+                                 MBED_CONF_UPDATE_CLIENT_METADATA_ADDRESS,
+                                 MBED_CONF_UPDATE_CLIENT_METADATA_SIZE);
+        VerificationCache verificationCache(recordLog);
+        // a compaction erases half of the metadata area, which would hold up an update session
+        // for much longer than a chunk, it is left to the next writer of the log
+        if (recordLog.init() == UC_ERR_NONE && ! recordLog.needsCompaction()) {
+            const int32_t cacheResult = (result == UC_ERR_NONE) ?
+                                        verificationCache.setVerified(headerAddress, headerCrc, firmwareVersion) :
+                                        verificationCache.invalidate(headerAddress);
+            if (cacheResult != UC_ERR_NONE) {
+                tr_error(" Cannot cache verification: %" PRIi32 "", cacheResult);
+            }
+        }
+    }
+    _mutex.unlock();
+}
+
+void IntegrityScrubber::setResult(uint32_t resultIndex, uint32_t headerCrc, int32_t result)
+{
+    CriticalSectionLock lock;
+    _results[resultIndex].headerCrc = headerCrc;
+    _results[resultIndex].result = result;
+    _results[resultIndex].nbrOfChecks++;
+}
+
+bool IntegrityScrubber::sleepFor(uint32_t timeMs)
+{
+    const uint32_t flags = _events.wait_any(STOP_EVENT_FLAG, timeMs, false);
+    return (flags & osFlagsError) != 0 || (flags & STOP_EVENT_FLAG) == 0;
+}
+
+} // namespace update_client
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "mbed.h"
+
+#include "flash_updater.hpp"
+#include "mbed_application.hpp"
+
+namespace update_client {
+
+// IntegrityScrubber verifies the active application and the applications stored in the
+// candidate slots in the background, so that a corrupted application is detected before it
+// is needed. A low priority thread hashes applications in chunks of
+// update-client.scrubber-chunk-size bytes, sleeping between chunks so that it uses at most
+// update-client.scrubber-cpu-budget percent of the CPU, and starts a new pass every
+// update-client.scrubber-period seconds. The result of each check is recorded in the
+// verification cache, if a metadata area is configured, unless recording it would compact
+// the metadata log
+// Update sessions must pause the scrubber while they use the flash, the metadata area or
+// the update client arena: pause() waits for the current chunk or the recording of a result
+// at most
+
+class IntegrityScrubber {
+public:
+    struct ScrubResult {
+        // the checked application, identified by its header CRC
+        uint32_t headerCrc;
+        // result of the last check, UC_ERR_NOT_FOUND if the application was not checked yet
+        int32_t result;
+        // number of completed checks
+        uint32_t nbrOfChecks;
+    };
+
+    // constructor
+    IntegrityScrubber();
+
+    // methods for starting and stopping the scrubber thread
+    void start();
+    void stop();
+    // suspend the scrubber after the current chunk, until resume() is called from the same thread
+    void pause();
+    void resume();
+
+    // results of the last checks, can be called from any thread
+    void getSlotResult(uint32_t slotIndex, ScrubResult &scrubResult) const;
+    void getActiveApplicationResult(ScrubResult &scrubResult) const;
+
+private:
+    // private methods
+    void run();
+    // check one application, returns false if the scrubber was stopped
+    bool scrubApplication(uint32_t resultIndex, uint32_t headerAddress, uint32_t applicationAddress);
+    void setResult(uint32_t resultIndex, uint32_t headerCrc, int32_t result);
+    // record the result in the verification cache, unless an update session ran since the check
+    void recordResult(uint32_t headerAddress, uint32_t headerCrc, uint64_t firmwareVersion,
+                      int32_t result, uint32_t nbrOfPauses);
+    // sleep for the given time, returns false if the scrubber was stopped
+    bool sleepFor(uint32_t timeMs);
+
+    // data members
+    Thread _scrubberThread;
+    EventFlags _events;
+    // held while a chunk is hashed, while a result is recorded and while the scrubber is paused
+    Mutex _mutex;
+    // incremented by pause(), a check interrupted by an update session is restarted
+    volatile uint32_t _nbrOfPauses;
+    FlashUpdater _flashUpdater;
+    // the results of the slots are followed by the result of the active application
+    static constexpr uint32_t kNbrOfResults = MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS + 1;
+    ScrubResult _results[kNbrOfResults];
+
+    enum {
+        STOP_EVENT_FLAG = 1
+    };
+    static constexpr uint32_t kChunkSize = MBED_CONF_UPDATE_CLIENT_SCRUBBER_CHUNK_SIZE;
+    static constexpr uint32_t kCpuBudget = MBED_CONF_UPDATE_CLIENT_SCRUBBER_CPU_BUDGET;
+    static constexpr uint32_t kPeriodMs = MBED_CONF_UPDATE_CLIENT_SCRUBBER_PERIOD * 1000UL;
+    static_assert(kChunkSize > 0, "the scrubber chunk size must not be 0");
+    static_assert(kCpuBudget > 0 && kCpuBudget <= 100, "the scrubber CPU budget must be a percentage");
+};
+
+} // namespace update_client
@@ -1,5 +1,10 @@
 #include "mbed_application.hpp"
+#include "application_digest.hpp"
+#include "flash_geometry.hpp"
+#include "uc_arena.hpp"
+#include "uc_crc32.hpp"
 #include "uc_error_codes.hpp"
+#include "verification_cache.hpp"
 
 #include "mbed_trace.h"
 #if MBED_CONF_MBED_TRACE_ENABLE
@@ -16,15 +21,25 @@ MbedApplication::MbedApplication(FlashUpdater &flashUpdater,
                                  uint32_t applicationHeaderAddress,
                                  uint32_t applicationAddress) :
     _flashUpdater(flashUpdater),
+    _verificationCache(NULL),
     _applicationHeaderAddress(applicationHeaderAddress),
     _applicationAddress(applicationAddress)
 {
-    memset(_buffer, 0, sizeof(_buffer));
     memset((void *) &_applicationHeader, 0, sizeof(_applicationHeader));
     _applicationHeader.initialized = false;
     _applicationHeader.state = NOT_CHECKED;
 }
 
+void *MbedApplication::operator new(size_t size)
+{
+    return UpdateClientArena::allocate(size);
+}
+
+void MbedApplication::operator delete(void *pMemory)
+{
+    UpdateClientArena::release(pMemory);
+}
+
 bool MbedApplication::isValid()
 {
     if (! _applicationHeader.initialized) {
@@ -71,6 +86,11 @@ uint64_t MbedApplication::getFirmwareSize()
     return _applicationHeader.firmwareSize;
 }
 
+bool MbedApplication::isKnownInvalid() const
+{
+    return _applicationHeader.initialized && _applicationHeader.state == NOT_VALID;
+}
+
 bool MbedApplication::isNewerThan(MbedApplication &otherApplication)
 {
     // read application header if required
@@ -110,6 +130,15 @@ int32_t MbedApplication::checkApplication()
     tr_debug(" Application size is %lld", _applicationHeader.firmwareSize);
 
     // at this stage, the header is valid
+    // skip hashing if the same application was already verified
+    if (_applicationHeader.firmwareSize > 0 && _verificationCache != NULL &&
+            _verificationCache->isVerified(_applicationHeaderAddress, _applicationHeader.headerCrc,
+                                           _applicationHeader.firmwareVersion)) {
+        tr_debug(" Application at address 0x%08" PRIx32 " was already verified", _applicationAddress);
+        _applicationHeader.state = VALID;
+        return UC_ERR_NONE;
+    }
+
     // calculate hash if slot is not empty
     if (_applicationHeader.firmwareSize > 0) {
         // initialize hashing facility
@@ -118,42 +147,17 @@ int32_t MbedApplication::checkApplication()
         mbedtls_sha256_starts(&mbedtls_ctx, 0);
 
         uint8_t SHA[kSizeOfSHA256] = { 0 };
-        uint32_t remaining = _applicationHeader.firmwareSize;
-
         // read full image
         tr_debug(" Calculating hash (start address 0x%08" PRIx32 ", size %" PRIu64 ")",
                  _applicationAddress, _applicationHeader.firmwareSize);
-        while (remaining > 0) {
-            // read full buffer or what is remaining
-            uint32_t readSize = (remaining > kBufferSize) ? kBufferSize : remaining;
-
-            // read buffer using FlashIAP API for portability */
-            int err = _flashUpdater.read(_buffer,
-                                         _applicationAddress + (_applicationHeader.firmwareSize - remaining),
-                                         readSize);
-            if (err != 0) {
-                tr_error(" Error while reading flash %d", err);
-                result = UC_ERR_READING_FLASH;
-                break;
-            }
-
-            // update hash
-            mbedtls_sha256_update(&mbedtls_ctx, _buffer, readSize);
-
-            // update remaining bytes
-            remaining -= readSize;
-        }
+        result = hashApplication(mbedtls_ctx, 0, (uint32_t) _applicationHeader.firmwareSize);
 
         // finalize hash
         mbedtls_sha256_finish(&mbedtls_ctx, SHA);
         mbedtls_sha256_free(&mbedtls_ctx);
 
         // compare calculated hash with hash from header
-        int diff = memcmp(_applicationHeader.hash, SHA, kSizeOfSHA256);
-
-        if (diff == 0) {
-            result = UC_ERR_NONE;
-        } else {
+        if (result == UC_ERR_NONE && memcmp(_applicationHeader.hash, SHA, kSizeOfSHA256) != 0) {
             result = UC_ERR_HASH_INVALID;
         }
     } else {
@@ -162,12 +166,112 @@ int32_t MbedApplication::checkApplication()
     }
     if (result == UC_ERR_NONE) {
         _applicationHeader.state = VALID;
+        updateVerificationCache();
+    } else {
+        _applicationHeader.state = NOT_VALID;
+    }
+    return result;
+}
+
+int32_t MbedApplication::startCheck(CheckState &checkState)
+{
+    checkState.nbrOfBytes = 0;
+    checkState.headerCrc = 0;
+
+    // the header is read again, the verification cache is not used so that a corruption is detected
+    int32_t result = readApplicationHeader();
+    if (result != UC_ERR_NONE) {
+        tr_error(" Invalid application header: %" PRIi32 "", result);
+        _applicationHeader.state = NOT_VALID;
+        return result;
+    }
+    checkState.headerCrc = _applicationHeader.headerCrc;
+    if (_applicationHeader.firmwareSize == 0) {
+        _applicationHeader.state = NOT_VALID;
+        return UC_ERR_FIRMWARE_EMPTY;
+    }
+
+    mbedtls_sha256_init(&checkState.shaContext);
+    mbedtls_sha256_starts(&checkState.shaContext, 0);
+
+    return UC_ERR_NONE;
+}
+
+int32_t MbedApplication::continueCheck(CheckState &checkState, uint32_t maxSize, bool &isComplete)
+{
+    isComplete = false;
+    const uint64_t remaining = _applicationHeader.firmwareSize - checkState.nbrOfBytes;
+    const uint32_t size = (remaining < maxSize) ? (uint32_t) remaining : maxSize;
+    int32_t result = hashApplication(checkState.shaContext, (uint32_t) checkState.nbrOfBytes, size);
+    if (result != UC_ERR_NONE) {
+        isComplete = true;
+        abortCheck(checkState);
+        return result;
+    }
+    checkState.nbrOfBytes += size;
+    if (checkState.nbrOfBytes < _applicationHeader.firmwareSize) {
+        return UC_ERR_NONE;
+    }
+
+    // the whole application is hashed, compare with the hash from the header
+    isComplete = true;
+    uint8_t SHA[kSizeOfSHA256] = { 0 };
+    mbedtls_sha256_finish(&checkState.shaContext, SHA);
+    mbedtls_sha256_free(&checkState.shaContext);
+    if (memcmp(_applicationHeader.hash, SHA, kSizeOfSHA256) == 0) {
+        _applicationHeader.state = VALID;
+        updateVerificationCache();
+        return UC_ERR_NONE;
+    }
+
+    // a previous verification no longer holds
+    tr_error(" Application at address 0x%08" PRIx32 " is corrupted", _applicationAddress);
+    _applicationHeader.state = NOT_VALID;
+    if (_verificationCache != NULL) {
+        _verificationCache->invalidate(_applicationHeaderAddress);
+    }
+    return UC_ERR_HASH_INVALID;
+}
+
+void MbedApplication::abortCheck(CheckState &checkState)
+{
+    mbedtls_sha256_free(&checkState.shaContext);
+}
+
+int32_t MbedApplication::checkApplication(const ApplicationDigest &digest)
+{
+    // read the header
+    int32_t result = readApplicationHeader();
+    if (result != UC_ERR_NONE) {
+        tr_error(" Invalid application header: %" PRIi32 "", result);
+        _applicationHeader.state = NOT_VALID;
+        return result;
+    }
+
+    // the digest was computed on the data written to flash, so comparing it with
+    // the hash from the header avoids reading the whole application again
+    if (_applicationHeader.firmwareSize == 0) {
+        result = UC_ERR_FIRMWARE_EMPTY;
+    } else if (! digest.isComplete() || digest.getFirmwareSize() != _applicationHeader.firmwareSize) {
+        result = UC_ERR_FIRMWARE_INCOMPLETE;
+    } else if (memcmp(_applicationHeader.hash, digest.getHash(), kSizeOfSHA256) != 0) {
+        result = UC_ERR_HASH_INVALID;
+    }
+
+    if (result == UC_ERR_NONE) {
+        _applicationHeader.state = VALID;
+        updateVerificationCache();
     } else {
         _applicationHeader.state = NOT_VALID;
     }
     return result;
 }
 
+void MbedApplication::setVerificationCache(VerificationCache *verificationCache)
+{
+    _verificationCache = verificationCache;
+}
+
 void MbedApplication::logApplicationInfo() const
 {  
     if (! _applicationHeader.initialized) {
@@ -220,33 +324,50 @@ void MbedApplication::compareTo(MbedApplication &otherApplication)
         const uint32_t pageSize = _flashUpdater.get_page_size();
         tr_debug("Flash page size is %" PRIu32 "", pageSize);
 
-        std::unique_ptr<char> readPageBuffer1 = std::unique_ptr<char>(new char[pageSize]);
-        std::unique_ptr<char> readPageBuffer2 = std::unique_ptr<char>(new char[pageSize]);
+        const uint32_t firmwareSize = (uint32_t) _applicationHeader.firmwareSize;
+        const uint8_t *pApplication1 = _flashUpdater.getFlashSpan(_applicationAddress, firmwareSize);
+        const uint8_t *pApplication2 = _flashUpdater.getFlashSpan(otherApplication._applicationAddress, firmwareSize);
         uint32_t address1 = _applicationAddress;
         uint32_t address2 = otherApplication._applicationAddress;
         uint32_t nbrOfBytes = 0;
         bool binariesMatch = true;
-        while (nbrOfBytes < _applicationHeader.firmwareSize) {
-            result = _flashUpdater.readPage(pageSize, readPageBuffer1.get(), address1);
-            if (result != UC_ERR_NONE) {
-                tr_error("Cannot read application 1 (address 0x%08" PRIx32 ")", address1);
-                binariesMatch = false;
-                break;
-            }
-            result = _flashUpdater.readPage(pageSize, readPageBuffer2.get(), address2);
-            if (result != UC_ERR_NONE) {
-                tr_error("Cannot read application 2 (address 0x%08" PRIx32 ")", address2);
-                binariesMatch = false;
-                break;
+        if (pApplication1 != NULL && pApplication2 != NULL) {
+            // compare the images in place, page by page for reporting where they differ
+            while (nbrOfBytes < firmwareSize) {
+                const uint32_t compareSize = (firmwareSize - nbrOfBytes < pageSize) ? (firmwareSize - nbrOfBytes) : pageSize;
+                if (memcmp(&pApplication1[nbrOfBytes], &pApplication2[nbrOfBytes], compareSize) != 0) {
+                    tr_error("Applications differ at byte %" PRIu32 " (address1 0x%08" PRIx32 " - address2 0x%08" PRIx32 ")",
+                             nbrOfBytes, address1 + nbrOfBytes, address2 + nbrOfBytes);
+                    binariesMatch = false;
+                    break;
+                }
+                nbrOfBytes += compareSize;
             }
+        } else {
+            PageBuffer readPageBuffer1(pageSize);
+            PageBuffer readPageBuffer2(pageSize);
+            while (nbrOfBytes < firmwareSize) {
+                result = _flashUpdater.readPage(pageSize, readPageBuffer1.get(), address1);
+                if (result != UC_ERR_NONE) {
+                    tr_error("Cannot read application 1 (address 0x%08" PRIx32 ")", address1);
+                    binariesMatch = false;
+                    break;
+                }
+                result = _flashUpdater.readPage(pageSize, readPageBuffer2.get(), address2);
+                if (result != UC_ERR_NONE) {
+                    tr_error("Cannot read application 2 (address 0x%08" PRIx32 ")", address2);
+                    binariesMatch = false;
+                    break;
+                }
 
-            if (memcmp(readPageBuffer1.get(), readPageBuffer2.get(), pageSize) != 0) {
-                tr_error("Applications differ at byte %" PRIu32 " (address1 0x%08" PRIx32 " - address2 0x%08" PRIx32 ")",
-                         nbrOfBytes, address1, address2);
-                binariesMatch = false;
-                break;
+                if (memcmp(readPageBuffer1.get(), readPageBuffer2.get(), pageSize) != 0) {
+                    tr_error("Applications differ at byte %" PRIu32 " (address1 0x%08" PRIx32 " - address2 0x%08" PRIx32 ")",
+                             nbrOfBytes, address1, address2);
+                    binariesMatch = false;
+                    break;
+                }
+                nbrOfBytes += pageSize;
             }
-            nbrOfBytes += pageSize;
         }
 
         if (binariesMatch) {
@@ -260,33 +381,31 @@ int32_t MbedApplication::readApplicationHeader()
     // default return code
     int32_t result = UC_ERR_INVALID_HEADER;
 
-    // read magic number and version
-    uint8_t version_buffer[8] = { 0 };
-    int err = _flashUpdater.read(version_buffer, _applicationHeaderAddress, 8);
+    // read the whole header at once, the magic number and version are at the start
+    // of the header so a single read is enough for telling the version
+    uint8_t read_buffer[kHeaderSizeV2] = { 0 };
+    int err = _flashUpdater.read(read_buffer, _applicationHeaderAddress, kHeaderSizeV2);
     if (0 == err) {
         // read out header magic
-        _applicationHeader.magic = parseUint32(&version_buffer[0]);
-        // read out header magic
-        _applicationHeader.headerVersion = parseUint32(&version_buffer[4]);
+        _applicationHeader.magic = parseUint32(&read_buffer[0]);
+        // read out header version
+        _applicationHeader.headerVersion = parseUint32(&read_buffer[4]);
+
+        // an empty slot or an incomplete image is rejected without further checks
+        if (_applicationHeader.magic == kErasedMagic) {
+            tr_debug(" No header at address 0x%08" PRIx32 " (erased)", _applicationHeaderAddress);
+            _applicationHeader.headerVersion = 0;
+        }
 
         // choose version to decode
         switch (_applicationHeader.headerVersion) {
             case kHeaderVersionV2: {
-                result = UC_ERR_NONE;
                 // Check the header magic
                 if (_applicationHeader.magic == KheaderMagicV2) {
-                    uint8_t read_buffer[kHeaderSizeV2] = { 0 };
-                    // read the rest of header (V2)
-                    err = _flashUpdater.read(read_buffer, _applicationHeaderAddress, kHeaderSizeV2);
-                    if (err == 0) {
-                        // parse the header
-                        result = parseInternalHeaderV2(read_buffer);
-                        if (result != UC_ERR_NONE) {
-                            tr_error(" Failed to parse header: %" PRIi32 "", result);
-                        }
-                    } else {
-                        tr_error("Flash read failed: %d", err);
-                        result = UC_ERR_READING_FLASH;
+                    // parse the header
+                    result = parseInternalHeaderV2(read_buffer);
+                    if (result != UC_ERR_NONE) {
+                        tr_error(" Failed to parse header: %" PRIi32 "", result);
                     }
                 } else {
                     tr_error(" Invalid magic number");
@@ -295,62 +414,125 @@ int32_t MbedApplication::readApplicationHeader()
             }
             break;
 
-        // Other firmware header versions can be supported here
-    default:
-        break;
+            // Other firmware header versions can be supported here
+            default:
+                break;
+        }
+    } else {
+        tr_error("Flash read failed: %d", err);
+        result = UC_ERR_READING_FLASH;
     }
-} else
-{
-    tr_error("Flash read failed: %d", err);
-    result = UC_ERR_READING_FLASH;
-}
 
-_applicationHeader.initialized = true;
-if (result == UC_ERR_NONE)
-{
-    _applicationHeader.state = VALID;
-} else
-{
-    _applicationHeader.state = NOT_VALID;
-}
+    _applicationHeader.initialized = true;
+    if (result == UC_ERR_NONE) {
+        // the header is valid but the application still needs to be hashed
+        _applicationHeader.state = NOT_CHECKED;
+    } else {
+        _applicationHeader.state = NOT_VALID;
+    }
 
-return result;
+    return result;
 }
 
 int32_t MbedApplication::parseInternalHeaderV2(const uint8_t *pBuffer)
 {
     // we expect pBuffer to contain the entire header (version 2)
-    int32_t result = UC_ERR_INVALID_HEADER;
+    HeaderFields headerFields;
+    int32_t result = parseHeader(pBuffer, headerFields);
+    if (result == UC_ERR_NONE) {
+        _applicationHeader.firmwareVersion = headerFields.firmwareVersion;
+        _applicationHeader.firmwareSize = headerFields.firmwareSize;
 
-    if (pBuffer != NULL) {
-        // calculate CRC
-        uint32_t calculatedChecksum = crc32(pBuffer, kHeaderCrcOffsetV2);
+        tr_debug(" headerVersion %" PRIi32 ", firmwareVersion %" PRIu64 ", firmwareSize %" PRIu64 "",
+                 _applicationHeader.headerVersion, _applicationHeader.firmwareVersion,
+                 _applicationHeader.firmwareSize);
 
-        // read out CRC
-        uint32_t temp32 = parseUint32(&pBuffer[kHeaderCrcOffsetV2]);
+        memcpy(_applicationHeader.hash, headerFields.hash, SHA256_SIZE);
+        memcpy(_applicationHeader.campaign, &pBuffer[kCampaingOffetV2], GUID_SIZE);
+        _applicationHeader.headerCrc = headerFields.headerCrc;
+    }
 
-        if (temp32 == calculatedChecksum) {
-            // parse content
-            _applicationHeader.firmwareVersion = parseUint64(&pBuffer[kFirmwareVersionOffsetV2]);
-            _applicationHeader.firmwareSize = parseUint64(&pBuffer[kFirmwareSizeOffsetV2]);
+    return result;
+}
 
-            tr_debug(" headerVersion %" PRIi32 ", firmwareVersion %" PRIu64 ", firmwareSize %" PRIu64 "",
-                     _applicationHeader.headerVersion, _applicationHeader.firmwareVersion,
-                     _applicationHeader.firmwareSize);
+int32_t MbedApplication::hashApplication(mbedtls_sha256_context &shaContext, uint32_t offset, uint32_t size)
+{
+    const uint8_t *pApplication = _flashUpdater.getFlashSpan(_applicationAddress + offset, size);
+    if (pApplication != NULL) {
+        // hash the image in place
+        mbedtls_sha256_update(&shaContext, pApplication, size);
+        return UC_ERR_NONE;
+    }
+
+    // buffer used for reading the application, only needed while hashing
+    uint8_t buffer[kBufferSize];
+    uint32_t remaining = size;
+    while (remaining > 0) {
+        // read full buffer or what is remaining
+        uint32_t readSize = (remaining > kBufferSize) ? kBufferSize : remaining;
+
+        // read buffer using FlashIAP API for portability */
+        int err = _flashUpdater.read(buffer, _applicationAddress + offset + (size - remaining), readSize);
+        if (err != 0) {
+            tr_error(" Error while reading flash %d", err);
+            return UC_ERR_READING_FLASH;
+        }
 
-            memcpy(_applicationHeader.hash, &pBuffer[kHashOffsetV2], SHA256_SIZE);
-            memcpy(_applicationHeader.campaign, &pBuffer[kCampaingOffetV2], GUID_SIZE);
+        // update hash
+        mbedtls_sha256_update(&shaContext, buffer, readSize);
 
-            // set result
-            result = UC_ERR_NONE;
-        } else {
-            result = UC_ERR_INVALID_CHECKSUM;
+        // update remaining bytes
+        remaining -= readSize;
+    }
+
+    return UC_ERR_NONE;
+}
+
+void MbedApplication::updateVerificationCache()
+{
+    if (_verificationCache != NULL) {
+        int32_t result = _verificationCache->setVerified(_applicationHeaderAddress, _applicationHeader.headerCrc,
+                                                         _applicationHeader.firmwareVersion);
+        if (result != UC_ERR_NONE) {
+            tr_error(" Cannot cache verification: %" PRIi32 "", result);
         }
     }
+}
+
+int32_t MbedApplication::parseFirmwareSize(const uint8_t *pBuffer, uint64_t &firmwareSize)
+{
+    HeaderFields headerFields;
+    int32_t result = parseHeader(pBuffer, headerFields);
+    if (result == UC_ERR_NONE) {
+        firmwareSize = headerFields.firmwareSize;
+    }
 
     return result;
 }
 
+int32_t MbedApplication::parseHeader(const uint8_t *pBuffer, HeaderFields &headerFields)
+{
+    // we expect pBuffer to contain the entire header (version 2)
+    if (pBuffer == NULL ||
+            parseUint32(&pBuffer[0]) != KheaderMagicV2 ||
+            parseUint32(&pBuffer[4]) != kHeaderVersionV2) {
+        return UC_ERR_INVALID_HEADER;
+    }
+
+    // calculate CRC and compare with the CRC from the header
+    headerFields.headerCrc = parseUint32(&pBuffer[kHeaderCrcOffsetV2]);
+    if (headerFields.headerCrc != crc32(pBuffer, kHeaderCrcOffsetV2)) {
+        return UC_ERR_INVALID_CHECKSUM;
+    }
+
+    // parse content
+    headerFields.firmwareVersion = parseUint64(&pBuffer[kFirmwareVersionOffsetV2]);
+    headerFields.firmwareSize = parseUint64(&pBuffer[kFirmwareSizeOffsetV2]);
+    memcpy(headerFields.hash, &pBuffer[kHashOffsetV2], SHA256_SIZE);
+
+    return UC_ERR_NONE;
+}
+
 uint32_t MbedApplication::parseUint32(const uint8_t *pBuffer)
 {
     uint32_t result = 0;
@@ -383,23 +565,7 @@ uint64_t MbedApplication::parseUint64(const uint8_t *pBuffer)
 
 uint32_t MbedApplication::crc32(const uint8_t *pBuffer, uint32_t length)
 {
-    const uint8_t *pCurrent = pBuffer;
-    uint32_t crc = 0xFFFFFFFF;
-
-    while (length--) {
-        crc ^= *pCurrent;
-        pCurrent++;
-
-        for (uint32_t counter = 0; counter < 8; counter++) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0xEDB88320;
-            } else {
-                crc = crc >> 1;
-            }
-        }
-    }
-
-    return (crc ^ 0xFFFFFFFF);
+    return update_client::crc32(pBuffer, length);
 }
 
 } // namesapce
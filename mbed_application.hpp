@@ -4,12 +4,21 @@
 
 #include "flash_updater.hpp"
 
+#include "mbedtls/sha256.h"
+
 namespace update_client {
 
+class ApplicationDigest;
+class VerificationCache;
+
 class MbedApplication {
 public:
     // constructor
     MbedApplication(FlashUpdater &flashUpdater, uint32_t applicationHeaderAddress, uint32_t applicationAddress);
+
+    // instances are allocated from the update client arena
+    static void *operator new(size_t size);
+    static void operator delete(void *pMemory);
     
     // public methods
     bool isValid();
@@ -17,13 +26,53 @@ public:
     uint64_t getFirmwareSize();
     bool isNewerThan(MbedApplication &otherApplication);
     int32_t checkApplication();
+    // check the application against a digest computed while the image was written
+    int32_t checkApplication(const ApplicationDigest &digest);
     void logApplicationInfo() const;
     void compareTo(MbedApplication &otherApplication);
+    // use a cache of verified applications to avoid hashing unchanged applications
+    void setVerificationCache(VerificationCache *verificationCache);
+
+    // incremental check, for hashing the application in steps of a bounded size. The
+    // verification cache is updated with the result but never used for skipping the check
+    struct CheckState {
+        mbedtls_sha256_context shaContext;
+        uint64_t nbrOfBytes;
+        // identifies the checked application
+        uint32_t headerCrc;
+    };
+    int32_t startCheck(CheckState &checkState);
+    // hash at most maxSize more bytes, isComplete is set once the check ended (with the
+    // result of the check) and the state must then not be used anymore
+    int32_t continueCheck(CheckState &checkState, uint32_t maxSize, bool &isComplete);
+    // release a check that is not complete
+    void abortCheck(CheckState &checkState);
+
+    // returns true if the header or a previous check showed that the application is not valid
+    bool isKnownInvalid() const;
+
+    // size of the V2 header (see the definition of the constants below)
+    static constexpr uint32_t kHeaderSizeV2 = 112;
+    static constexpr uint32_t kHashSize = (256 / 8);
+
+    // fields of a V2 header used for selecting and verifying applications
+    struct HeaderFields {
+        uint64_t firmwareVersion;
+        uint64_t firmwareSize;
+        uint32_t headerCrc;
+        uint8_t hash[kHashSize];
+    };
+    // parse a V2 header buffer of kHeaderSizeV2 bytes, checking magic, version and CRC
+    static int32_t parseHeader(const uint8_t *pBuffer, HeaderFields &headerFields);
+    // parse the firmware size from a V2 header buffer of kHeaderSizeV2 bytes
+    static int32_t parseFirmwareSize(const uint8_t *pBuffer, uint64_t &firmwareSize);
 
 private:
     // private methods
     int32_t readApplicationHeader();
     int32_t parseInternalHeaderV2(const uint8_t *pBuffer);
+    int32_t hashApplication(mbedtls_sha256_context &shaContext, uint32_t offset, uint32_t size);
+    void updateVerificationCache();
 
     static uint32_t parseUint32(const uint8_t *pBuffer);
     static uint64_t parseUint64(const uint8_t *pBuffer);
@@ -31,6 +80,7 @@ private:
 
     // data members
     FlashUpdater &_flashUpdater;
+    VerificationCache *_verificationCache;
     const uint32_t _applicationHeaderAddress;
     const uint32_t _applicationAddress;
 
@@ -57,6 +107,7 @@ private:
         hash_t hash;
         guid_t campaign;
         uint32_t signatureSize;
+        uint32_t headerCrc;
         uint8_t signature[0];
         ApplicationState state;
     };
@@ -68,7 +119,8 @@ private:
     // constants defining the header
     static constexpr uint32_t kHeaderVersionV2 = 2;
     static constexpr uint32_t KheaderMagicV2 = 0x5a51b3d4UL;
-    static constexpr uint32_t kHeaderSizeV2 = 112;
+    // the header is programmed last, so the magic of an incomplete image is still erased
+    static constexpr uint32_t kErasedMagic = 0xffffffffUL;
     static constexpr uint32_t kFirmwareVersionOffsetV2 = 8;
     static constexpr uint32_t kFirmwareSizeOffsetV2 = 16;
     static constexpr uint32_t kHashOffsetV2 = 24;
@@ -78,9 +130,8 @@ private:
 
     // other constants
     static constexpr uint32_t kSizeOfSHA256 = (256 / 8);
+    // size of the buffer used for reading the application while hashing
     static constexpr uint32_t kBufferSize = 256;
-    // buffer used in storage operations
-    uint8_t _buffer[kBufferSize];
 };
 
 } // namespace update_client
\ No newline at end of file
@@ -0,0 +1,270 @@
+#include "sim_flash_iap.hpp"
+#include "uc_error_codes.hpp"
+
+#include <cstring>
+
+namespace update_client {
+
+#if (USE_SIMULATED_FLASH_UC == 1)
+
+SimFlashDevice::SimFlashDevice() :
+    _flashStart(0),
+    _pageSize(0),
+    _eraseValue(0xFF),
+    _nbrOfSectorRegions(0)
+{
+    memset(_sectorRegions, 0, sizeof(_sectorRegions));
+    memset(&_costModel, 0, sizeof(_costModel));
+    resetStats();
+}
+
+SimFlashDevice &SimFlashDevice::getDefault()
+{
+    static SimFlashDevice defaultDevice;
+    return defaultDevice;
+}
+
+int32_t SimFlashDevice::configure(uint32_t flashStart, uint32_t pageSize, const SectorRegion *pSectorRegions,
+                                  uint32_t nbrOfSectorRegions, const CostModel &costModel, uint8_t eraseValue)
+{
+    if (pSectorRegions == NULL || nbrOfSectorRegions == 0 || nbrOfSectorRegions > kMaxSectorRegions || pageSize == 0) {
+        return UC_ERR_INVALID_PARAMETER;
+    }
+
+    // the current configuration is kept if the new one is rejected
+    uint32_t flashSize = 0;
+    for (uint32_t regionIndex = 0; regionIndex < nbrOfSectorRegions; regionIndex++) {
+        // sectors must be made of full pages
+        if (pSectorRegions[regionIndex].sectorSize == 0 ||
+                (pSectorRegions[regionIndex].sectorSize % pageSize) != 0) {
+            return UC_ERR_INVALID_PARAMETER;
+        }
+        flashSize += pSectorRegions[regionIndex].sectorSize * pSectorRegions[regionIndex].nbrOfSectors;
+    }
+
+    memcpy(_sectorRegions, pSectorRegions, nbrOfSectorRegions * sizeof(SectorRegion));
+    _flashStart = flashStart;
+    _pageSize = pageSize;
+    _eraseValue = eraseValue;
+    _nbrOfSectorRegions = nbrOfSectorRegions;
+    _costModel = costModel;
+    _memory.assign(flashSize, eraseValue);
+    resetStats();
+
+    return UC_ERR_NONE;
+}
+
+int SimFlashDevice::read(void *buffer, uint32_t addr, uint32_t size)
+{
+    if (addr < _flashStart || (addr - _flashStart) + size > _memory.size()) {
+        return -1;
+    }
+    memcpy(buffer, &_memory[addr - _flashStart], size);
+
+    _stats.nbrOfReads++;
+    _stats.bytesRead += size;
+    _stats.modeledTimeNs += ((uint64_t) size * _costModel.readTimePerKiBNs) / 1024;
+
+    return 0;
+}
+
+int SimFlashDevice::program(const void *buffer, uint32_t addr, uint32_t size)
+{
+    // as FlashIAP, only full pages can be programmed
+    if (addr < _flashStart || (addr - _flashStart) + size > _memory.size() ||
+            (addr - _flashStart) % _pageSize != 0 || size % _pageSize != 0) {
+        return -1;
+    }
+
+    // programming can only clear bits, which is what happens on NOR flash
+    // when a page is programmed twice without being erased
+    const uint8_t *pData = static_cast<const uint8_t *>(buffer);
+    uint8_t *pMemory = &_memory[addr - _flashStart];
+    for (uint32_t index = 0; index < size; index++) {
+        if (_eraseValue == 0xFF) {
+            pMemory[index] &= pData[index];
+        } else {
+            pMemory[index] |= pData[index];
+        }
+    }
+
+    _stats.nbrOfPrograms++;
+    _stats.bytesProgrammed += size;
+    _stats.modeledTimeNs += (uint64_t)(size / _pageSize) * _costModel.programPageTimeUs * 1000;
+
+    return 0;
+}
+
+int SimFlashDevice::erase(uint32_t addr, uint32_t size)
+{
+    // as FlashIAP, the range must start and end on sector boundaries
+    if (addr < _flashStart || (addr - _flashStart) + size > _memory.size() ||
+            !isSectorAligned(addr) || !isSectorAligned(addr + size)) {
+        return -1;
+    }
+
+    uint32_t sectorAddress = addr;
+    while (sectorAddress < addr + size) {
+        const uint32_t sectorSize = get_sector_size(sectorAddress);
+        memset(&_memory[sectorAddress - _flashStart], _eraseValue, sectorSize);
+
+        _stats.nbrOfErases++;
+        _stats.bytesErased += sectorSize;
+        _stats.modeledTimeNs += ((uint64_t) _costModel.eraseSectorTimeUs +
+                                 ((uint64_t) sectorSize * _costModel.eraseTimePerKiBUs) / 1024) * 1000;
+
+        sectorAddress += sectorSize;
+    }
+
+    return 0;
+}
+
+uint32_t SimFlashDevice::get_sector_size(uint32_t addr) const
+{
+    if (addr < _flashStart) {
+        return 0;
+    }
+
+    uint32_t regionStartAddress = _flashStart;
+    for (uint32_t regionIndex = 0; regionIndex < _nbrOfSectorRegions; regionIndex++) {
+        const uint32_t regionSize = _sectorRegions[regionIndex].sectorSize * _sectorRegions[regionIndex].nbrOfSectors;
+        if (addr < regionStartAddress + regionSize) {
+            return _sectorRegions[regionIndex].sectorSize;
+        }
+        regionStartAddress += regionSize;
+    }
+
+    // out of bounds, as for the HAL
+    return 0;
+}
+
+uint32_t SimFlashDevice::get_flash_start() const
+{
+    return _flashStart;
+}
+
+uint32_t SimFlashDevice::get_flash_size() const
+{
+    return _memory.size();
+}
+
+uint32_t SimFlashDevice::get_page_size() const
+{
+    return _pageSize;
+}
+
+uint8_t SimFlashDevice::get_erase_value() const
+{
+    return _eraseValue;
+}
+
+const uint8_t *SimFlashDevice::map(uint32_t addr, uint32_t size)
+{
+    if (addr < _flashStart || (addr - _flashStart) + size > _memory.size()) {
+        return NULL;
+    }
+
+    // reading mapped flash costs the same bus bandwidth as read(), without the copy
+    _stats.nbrOfReads++;
+    _stats.bytesRead += size;
+    _stats.modeledTimeNs += ((uint64_t) size * _costModel.readTimePerKiBNs) / 1024;
+
+    return &_memory[addr - _flashStart];
+}
+
+uint8_t *SimFlashDevice::getMemory()
+{
+    return _memory.data();
+}
+
+const SimFlashDevice::Stats &SimFlashDevice::getStats() const
+{
+    return _stats;
+}
+
+void SimFlashDevice::resetStats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool SimFlashDevice::isSectorAligned(uint32_t addr) const
+{
+    // the end of the flash is considered as a sector boundary
+    uint32_t regionStartAddress = _flashStart;
+    for (uint32_t regionIndex = 0; regionIndex < _nbrOfSectorRegions; regionIndex++) {
+        const uint32_t regionSize = _sectorRegions[regionIndex].sectorSize * _sectorRegions[regionIndex].nbrOfSectors;
+        if (addr < regionStartAddress + regionSize) {
+            return addr >= regionStartAddress &&
+                   ((addr - regionStartAddress) % _sectorRegions[regionIndex].sectorSize) == 0;
+        }
+        regionStartAddress += regionSize;
+    }
+
+    return addr == regionStartAddress;
+}
+
+SimFlashIAP::SimFlashIAP() :
+    _device(SimFlashDevice::getDefault())
+{
+
+}
+
+int SimFlashIAP::init()
+{
+    // the device must have been configured
+    return (_device.get_flash_size() > 0) ? 0 : -1;
+}
+
+int SimFlashIAP::deinit()
+{
+    return 0;
+}
+
+int SimFlashIAP::read(void *buffer, uint32_t addr, uint32_t size)
+{
+    return _device.read(buffer, addr, size);
+}
+
+int SimFlashIAP::program(const void *buffer, uint32_t addr, uint32_t size)
+{
+    return _device.program(buffer, addr, size);
+}
+
+int SimFlashIAP::erase(uint32_t addr, uint32_t size)
+{
+    return _device.erase(addr, size);
+}
+
+uint32_t SimFlashIAP::get_sector_size(uint32_t addr) const
+{
+    return _device.get_sector_size(addr);
+}
+
+uint32_t SimFlashIAP::get_flash_start() const
+{
+    return _device.get_flash_start();
+}
+
+uint32_t SimFlashIAP::get_flash_size() const
+{
+    return _device.get_flash_size();
+}
+
+uint32_t SimFlashIAP::get_page_size() const
+{
+    return _device.get_page_size();
+}
+
+uint8_t SimFlashIAP::get_erase_value() const
+{
+    return _device.get_erase_value();
+}
+
+const uint8_t *SimFlashIAP::map(uint32_t addr, uint32_t size)
+{
+    return _device.map(addr, size);
+}
+
+#endif // USE_SIMULATED_FLASH_UC
+
+} // namespace update_client
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace update_client {
+
+#if (USE_SIMULATED_FLASH_UC == 1)
+
+// SimFlashDevice is a RAM backed model of an internal flash that can be built on the host
+// It supports a non uniform sector map, a page size, erase semantics (erased bytes read as
+// the erase value and programming can only clear bits) and a cost model that accumulates the
+// time the operations would take on the modeled device
+
+class SimFlashDevice {
+public:
+    // a run of sectors of identical size
+    struct SectorRegion {
+        uint32_t sectorSize;
+        uint32_t nbrOfSectors;
+    };
+
+    // latencies of the modeled device
+    struct CostModel {
+        uint32_t eraseSectorTimeUs;
+        uint32_t eraseTimePerKiBUs;
+        uint32_t programPageTimeUs;
+        uint32_t readTimePerKiBNs;
+    };
+
+    // statistics accumulated since the last call to resetStats()
+    struct Stats {
+        uint32_t nbrOfErases;
+        uint64_t bytesErased;
+        uint32_t nbrOfPrograms;
+        uint64_t bytesProgrammed;
+        uint32_t nbrOfReads;
+        uint64_t bytesRead;
+        uint64_t modeledTimeNs;
+    };
+
+    static constexpr uint32_t kMaxSectorRegions = 8;
+
+    SimFlashDevice();
+
+    // returns the device used by SimFlashIAP instances
+    static SimFlashDevice &getDefault();
+
+    // configure the geometry and the cost model, the content is reset to the erase value
+    int32_t configure(uint32_t flashStart, uint32_t pageSize, const SectorRegion *pSectorRegions,
+                      uint32_t nbrOfSectorRegions, const CostModel &costModel, uint8_t eraseValue = 0xFF);
+
+    // FlashIAP like interface
+    int read(void *buffer, uint32_t addr, uint32_t size);
+    int program(const void *buffer, uint32_t addr, uint32_t size);
+    int erase(uint32_t addr, uint32_t size);
+    uint32_t get_sector_size(uint32_t addr) const;
+    uint32_t get_flash_start() const;
+    uint32_t get_flash_size() const;
+    uint32_t get_page_size() const;
+    uint8_t get_erase_value() const;
+    // pointer for reading a range in place, as for memory mapped flash (the read cost is accounted)
+    const uint8_t *map(uint32_t addr, uint32_t size);
+
+    // direct access to the simulated memory (no cost is accounted)
+    uint8_t *getMemory();
+
+    const Stats &getStats() const;
+    void resetStats();
+
+private:
+    bool isSectorAligned(uint32_t addr) const;
+
+    // data members
+    uint32_t _flashStart;
+    uint32_t _pageSize;
+    uint8_t _eraseValue;
+    SectorRegion _sectorRegions[kMaxSectorRegions];
+    uint32_t _nbrOfSectorRegions;
+    CostModel _costModel;
+    Stats _stats;
+    std::vector<uint8_t> _memory;
+};
+
+// SimFlashIAP exposes the same interface as mbed's FlashIAP on top of a SimFlashDevice
+// All instances share the default device, so that the content survives the creation of
+// new FlashUpdater instances as it does on the target
+
+class SimFlashIAP {
+public:
+    SimFlashIAP();
+
+    int init();
+    int deinit();
+    int read(void *buffer, uint32_t addr, uint32_t size);
+    int program(const void *buffer, uint32_t addr, uint32_t size);
+    int erase(uint32_t addr, uint32_t size);
+    uint32_t get_sector_size(uint32_t addr) const;
+    uint32_t get_flash_start() const;
+    uint32_t get_flash_size() const;
+    uint32_t get_page_size() const;
+    uint8_t get_erase_value() const;
+    const uint8_t *map(uint32_t addr, uint32_t size);
+
+private:
+    SimFlashDevice &_device;
+};
+
+#endif // USE_SIMULATED_FLASH_UC
+
+} // namespace update_client
@@ -0,0 +1,123 @@
+#include "slot_metadata_index.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "SlotMetadataIndex"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+SlotMetadataIndex::SlotMetadataIndex(FlashUpdater &flashUpdater) :
+    _flashUpdater(flashUpdater)
+{
+    memset(_slotMetadataArray, 0, sizeof(_slotMetadataArray));
+    for (uint32_t slotIndex = 0; slotIndex < MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS; slotIndex++) {
+        _slotMetadataArray[slotIndex].state = SLOT_NOT_VALID;
+    }
+}
+
+int32_t SlotMetadataIndex::readSlot(uint32_t slotIndex, uint32_t headerAddress)
+{
+    SlotMetadata &slotMetadata = _slotMetadataArray[slotIndex];
+    memset(&slotMetadata, 0, sizeof(slotMetadata));
+    slotMetadata.state = SLOT_NOT_VALID;
+
+    uint8_t headerBuffer[MbedApplication::kHeaderSizeV2] = { 0 };
+    int err = _flashUpdater.read(headerBuffer, headerAddress, sizeof(headerBuffer));
+    if (err != 0) {
+        tr_error("Flash read failed: %d", err);
+        return UC_ERR_READING_FLASH;
+    }
+
+    MbedApplication::HeaderFields headerFields;
+    int32_t result = MbedApplication::parseHeader(headerBuffer, headerFields);
+    if (result != UC_ERR_NONE) {
+        tr_debug(" No valid header in slot %" PRIu32 ": %" PRIi32 "", slotIndex, result);
+        return result;
+    }
+
+    slotMetadata.firmwareVersion = headerFields.firmwareVersion;
+    slotMetadata.firmwareSize = (uint32_t) headerFields.firmwareSize;
+    slotMetadata.headerCrc = headerFields.headerCrc;
+    memcpy(slotMetadata.hash, headerFields.hash, sizeof(slotMetadata.hash));
+    slotMetadata.state = (headerFields.firmwareSize == 0) ? SLOT_EMPTY : SLOT_NOT_CHECKED;
+    tr_debug(" Slot %" PRIu32 ": firmwareVersion %" PRIu64 ", firmwareSize %" PRIu32 "",
+             slotIndex, slotMetadata.firmwareVersion, slotMetadata.firmwareSize);
+
+    return UC_ERR_NONE;
+}
+
+SlotMetadataIndex::SlotState SlotMetadataIndex::getState(uint32_t slotIndex) const
+{
+    return (SlotState) _slotMetadataArray[slotIndex].state;
+}
+
+void SlotMetadataIndex::setState(uint32_t slotIndex, SlotState state)
+{
+    _slotMetadataArray[slotIndex].state = state;
+}
+
+uint64_t SlotMetadataIndex::getFirmwareVersion(uint32_t slotIndex) const
+{
+    return _slotMetadataArray[slotIndex].firmwareVersion;
+}
+
+uint64_t SlotMetadataIndex::getFirmwareSize(uint32_t slotIndex) const
+{
+    return _slotMetadataArray[slotIndex].firmwareSize;
+}
+
+const SlotMetadataIndex::SlotMetadata &SlotMetadataIndex::getSlotMetadata(uint32_t slotIndex) const
+{
+    return _slotMetadataArray[slotIndex];
+}
+
+bool SlotMetadataIndex::isCandidate(uint32_t slotIndex) const
+{
+    const uint8_t state = _slotMetadataArray[slotIndex].state;
+    return state == SLOT_NOT_CHECKED || state == SLOT_VALID;
+}
+
+bool SlotMetadataIndex::isNewerThan(uint32_t slotIndex, uint32_t otherSlotIndex) const
+{
+    // if this application is not valid or empty, it cannot be newer
+    if (! isCandidate(slotIndex)) {
+        return false;
+    }
+    // if the other application is not valid or empty, this one is newer
+    if (! isCandidate(otherSlotIndex)) {
+        return true;
+    }
+
+    return getFirmwareVersion(otherSlotIndex) < getFirmwareVersion(slotIndex);
+}
+
+bool SlotMetadataIndex::isNewerThan(uint32_t slotIndex, MbedApplication &otherApplication) const
+{
+    // if this application is not valid or empty, it cannot be newer
+    if (! isCandidate(slotIndex)) {
+        return false;
+    }
+    // if the other application is not valid or empty, this one is newer
+    // (the firmware size is 0 if the header is not valid)
+    if (otherApplication.getFirmwareSize() == 0 || otherApplication.isKnownInvalid()) {
+        return true;
+    }
+
+    return otherApplication.getFirmwareVersion() < getFirmwareVersion(slotIndex);
+}
+
+bool SlotMetadataIndex::getNewestSlot(uint32_t nbrOfSlots, uint32_t &newestSlotIndex) const
+{
+    newestSlotIndex = nbrOfSlots;
+    for (uint32_t slotIndex = 0; slotIndex < nbrOfSlots; slotIndex++) {
+        if (newestSlotIndex == nbrOfSlots ? isCandidate(slotIndex) : isNewerThan(slotIndex, newestSlotIndex)) {
+            newestSlotIndex = slotIndex;
+        }
+    }
+
+    return newestSlotIndex != nbrOfSlots;
+}
+
+} // namespace update_client
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "mbed.h"
+
+#include "flash_updater.hpp"
+#include "mbed_application.hpp"
+
+namespace update_client {
+
+// SlotMetadataIndex keeps the header fields of the application stored in each slot in a
+// compact array. Each header is read once, with a single read, when the slot is added,
+// and version and size queries are then answered without accessing the flash
+
+class SlotMetadataIndex {
+public:
+    enum SlotState {
+        // no valid header
+        SLOT_NOT_VALID,
+        // valid header of an empty application
+        SLOT_EMPTY,
+        // valid header, the application has not been hashed
+        SLOT_NOT_CHECKED,
+        // valid header and application
+        SLOT_VALID
+    };
+
+    MBED_PACKED(struct) SlotMetadata {
+        uint64_t firmwareVersion;
+        uint32_t firmwareSize;
+        uint32_t headerCrc;
+        uint8_t hash[MbedApplication::kHashSize];
+        uint8_t state;
+    };
+
+    // constructor
+    explicit SlotMetadataIndex(FlashUpdater &flashUpdater);
+
+    // read the header of the application in a slot
+    int32_t readSlot(uint32_t slotIndex, uint32_t headerAddress);
+
+    SlotState getState(uint32_t slotIndex) const;
+    void setState(uint32_t slotIndex, SlotState state);
+    uint64_t getFirmwareVersion(uint32_t slotIndex) const;
+    uint64_t getFirmwareSize(uint32_t slotIndex) const;
+    const SlotMetadata &getSlotMetadata(uint32_t slotIndex) const;
+    // returns true if the slot holds an application that may be valid
+    bool isCandidate(uint32_t slotIndex) const;
+    // same rules as MbedApplication::isNewerThan
+    bool isNewerThan(uint32_t slotIndex, uint32_t otherSlotIndex) const;
+    bool isNewerThan(uint32_t slotIndex, MbedApplication &otherApplication) const;
+    // returns the candidate with the highest firmware version
+    bool getNewestSlot(uint32_t nbrOfSlots, uint32_t &newestSlotIndex) const;
+
+private:
+    // data members
+    FlashUpdater &_flashUpdater;
+    SlotMetadata _slotMetadataArray[MBED_CONF_UPDATE_CLIENT_STORAGE_LOCATIONS];
+};
+
+} // namespace update_client
@@ -0,0 +1,39 @@
+#include "slot_wear_record.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "SlotWearRecord"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+SlotWearRecord::SlotWearRecord(FlashRecordLog &recordLog) :
+    _recordLog(recordLog)
+{
+
+}
+
+bool SlotWearRecord::getSlotWear(uint32_t headerAddress, uint32_t &eraseCount, bool &isBlank)
+{
+    eraseCount = 0;
+    isBlank = false;
+    FlashRecordLog::Record record;
+    if (_recordLog.find(kSlotWearRecordType, headerAddress, record) != UC_ERR_NONE) {
+        return false;
+    }
+    eraseCount = record.values[0];
+    isBlank = (record.values[1] != 0);
+
+    return true;
+}
+
+int32_t SlotWearRecord::setSlotWear(uint32_t headerAddress, uint32_t eraseCount, bool isBlank)
+{
+    tr_debug(" Slot at address 0x%08" PRIx32 ": %" PRIu32 " erase cycles%s",
+             headerAddress, eraseCount, isBlank ? " (blank)" : "");
+    const uint32_t values[FlashRecordLog::kNbrOfValues] = { eraseCount, isBlank ? 1U : 0U, 0, 0 };
+    return _recordLog.write(kSlotWearRecordType, headerAddress, values);
+}
+
+} // namespace update_client
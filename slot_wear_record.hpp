@@ -0,0 +1,29 @@
+#pragma once
+
+#include "flash_record_log.hpp"
+
+namespace update_client {
+
+// SlotWearRecord counts the erase cycles of each slot and remembers whether a slot was left
+// blank, so that the slot receiving a candidate can be chosen without reading the slots
+// Entries are keyed on the header address of the slot. Without an entry, a slot was never
+// erased by the update client and is not known to be blank
+
+class SlotWearRecord {
+public:
+    // constructor
+    explicit SlotWearRecord(FlashRecordLog &recordLog);
+
+    // returns false if no entry is recorded for the slot, in which case both values are cleared
+    bool getSlotWear(uint32_t headerAddress, uint32_t &eraseCount, bool &isBlank);
+    int32_t setSlotWear(uint32_t headerAddress, uint32_t eraseCount, bool isBlank);
+
+private:
+    // data members
+    FlashRecordLog &_recordLog;
+
+    // record types are unique among the users of the log
+    static constexpr uint16_t kSlotWearRecordType = 5;
+};
+
+} // namespace update_client
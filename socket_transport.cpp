@@ -0,0 +1,206 @@
+#include "socket_transport.hpp"
+#include "uc_error_codes.hpp"
+
+#if (USE_SOCKET_TRANSPORT_UC == 1)
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace update_client {
+
+SocketTransport::SocketTransport(uint16_t tcpPort) :
+    _tcpPort(tcpPort),
+    _listenSocket(-1),
+    _connectionSocket(-1)
+{
+    _unixSocketPath[0] = '\0';
+    _cancelPipe[0] = -1;
+    _cancelPipe[1] = -1;
+}
+
+SocketTransport::SocketTransport(const char *unixSocketPath) :
+    _tcpPort(0),
+    _listenSocket(-1),
+    _connectionSocket(-1)
+{
+    snprintf(_unixSocketPath, sizeof(_unixSocketPath), "%s", unixSocketPath);
+    _cancelPipe[0] = -1;
+    _cancelPipe[1] = -1;
+}
+
+SocketTransport::~SocketTransport()
+{
+    close();
+}
+
+int32_t SocketTransport::open()
+{
+    close();
+    if (pipe(_cancelPipe) != 0) {
+        return UC_ERR_INVALID_PARAMETER;
+    }
+    fcntl(_cancelPipe[1], F_SETFL, O_NONBLOCK);
+
+    int result = -1;
+    if (_unixSocketPath[0] != '\0') {
+        _listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s", _unixSocketPath);
+        unlink(_unixSocketPath);
+        result = bind(_listenSocket, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+    } else {
+        _listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+        const int reuseAddress = 1;
+        setsockopt(_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(_tcpPort);
+        result = bind(_listenSocket, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+    }
+    if (_listenSocket < 0 || result != 0 || listen(_listenSocket, 1) != 0) {
+        close();
+        return UC_ERR_INVALID_PARAMETER;
+    }
+
+    return UC_ERR_NONE;
+}
+
+void SocketTransport::close()
+{
+    closeConnection();
+    if (_listenSocket >= 0) {
+        ::close(_listenSocket);
+        _listenSocket = -1;
+        if (_unixSocketPath[0] != '\0') {
+            unlink(_unixSocketPath);
+        }
+    }
+    for (uint32_t pipeIndex = 0; pipeIndex < 2; pipeIndex++) {
+        if (_cancelPipe[pipeIndex] >= 0) {
+            ::close(_cancelPipe[pipeIndex]);
+            _cancelPipe[pipeIndex] = -1;
+        }
+    }
+}
+
+int32_t SocketTransport::waitForConnection(uint32_t timeoutMs)
+{
+    // a new connection replaces the previous one
+    closeConnection();
+    int32_t result = waitReadable(_listenSocket, timeoutMs);
+    if (result != UC_ERR_NONE) {
+        return result;
+    }
+    _connectionSocket = accept(_listenSocket, NULL, NULL);
+
+    return (_connectionSocket >= 0) ? UC_ERR_NONE : UC_ERR_DISCONNECTED;
+}
+
+bool SocketTransport::isConnected()
+{
+    return _connectionSocket >= 0;
+}
+
+int32_t SocketTransport::read(uint8_t *pBuffer, uint32_t size, uint32_t timeoutMs, uint32_t &nbrOfBytesRead)
+{
+    nbrOfBytesRead = 0;
+    if (_connectionSocket < 0) {
+        return UC_ERR_DISCONNECTED;
+    }
+    int32_t result = waitReadable(_connectionSocket, timeoutMs);
+    if (result != UC_ERR_NONE) {
+        return result;
+    }
+
+    const ssize_t count = recv(_connectionSocket, pBuffer, size, 0);
+    if (count <= 0) {
+        // the host closed the connection
+        closeConnection();
+        return UC_ERR_DISCONNECTED;
+    }
+    nbrOfBytesRead = (uint32_t) count;
+
+    return UC_ERR_NONE;
+}
+
+int32_t SocketTransport::write(const uint8_t *pBuffer, uint32_t size)
+{
+    uint32_t nbrOfBytesWritten = 0;
+    while (nbrOfBytesWritten < size) {
+        if (_connectionSocket < 0) {
+            return UC_ERR_DISCONNECTED;
+        }
+        const ssize_t count = send(_connectionSocket, &pBuffer[nbrOfBytesWritten], size - nbrOfBytesWritten, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            closeConnection();
+            return UC_ERR_DISCONNECTED;
+        }
+        nbrOfBytesWritten += (uint32_t) count;
+    }
+
+    return UC_ERR_NONE;
+}
+
+void SocketTransport::cancel()
+{
+    // the byte is never read, so that all later waits are cancelled as well
+    if (_cancelPipe[1] >= 0) {
+        const uint8_t cancelByte = 1;
+        (void) ::write(_cancelPipe[1], &cancelByte, sizeof(cancelByte));
+    }
+}
+
+int32_t SocketTransport::waitReadable(int socket, uint32_t timeoutMs)
+{
+    struct pollfd pollFds[2];
+    pollFds[0].fd = socket;
+    pollFds[0].events = POLLIN;
+    pollFds[1].fd = _cancelPipe[0];
+    pollFds[1].events = POLLIN;
+    while (true) {
+        pollFds[0].revents = 0;
+        pollFds[1].revents = 0;
+        const int timeout = (timeoutMs == kWaitForever) ? -1 : (int) timeoutMs;
+        const int count = poll(pollFds, 2, timeout);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            return UC_ERR_DISCONNECTED;
+        }
+        if (count == 0) {
+            return UC_ERR_TIMEOUT;
+        }
+        if ((pollFds[1].revents & POLLIN) != 0) {
+            return UC_ERR_CANCELLED;
+        }
+        return UC_ERR_NONE;
+    }
+}
+
+void SocketTransport::closeConnection()
+{
+    if (_connectionSocket >= 0) {
+        ::close(_connectionSocket);
+        _connectionSocket = -1;
+    }
+}
+
+} // namespace update_client
+
+#endif // USE_SOCKET_TRANSPORT_UC
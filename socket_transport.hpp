@@ -0,0 +1,48 @@
+#pragma once
+
+#include "uc_transport.hpp"
+
+namespace update_client {
+
+#if (USE_SOCKET_TRANSPORT_UC == 1)
+
+// SocketTransport is a transport over a TCP or a Unix domain stream socket
+// It only relies on POSIX sockets and is meant for feeding the downloader from a host
+// (with the simulated flash) when measuring the throughput of updates without hardware
+// A single host is served at a time
+
+class SocketTransport :
+    public Transport {
+public:
+    // listen on a TCP port of the loopback interface
+    explicit SocketTransport(uint16_t tcpPort);
+    // listen on a Unix domain socket
+    explicit SocketTransport(const char *unixSocketPath);
+    virtual ~SocketTransport();
+
+    virtual int32_t open();
+    virtual void close();
+    virtual int32_t waitForConnection(uint32_t timeoutMs);
+    virtual bool isConnected();
+    virtual int32_t read(uint8_t *pBuffer, uint32_t size, uint32_t timeoutMs, uint32_t &nbrOfBytesRead);
+    virtual int32_t write(const uint8_t *pBuffer, uint32_t size);
+    virtual void cancel();
+
+private:
+    // wait until the socket is readable, returns UC_ERR_NONE, UC_ERR_TIMEOUT or UC_ERR_CANCELLED
+    int32_t waitReadable(int socket, uint32_t timeoutMs);
+    void closeConnection();
+
+    // data members
+    static constexpr uint32_t kMaxPathLength = 108;
+    uint16_t _tcpPort;
+    char _unixSocketPath[kMaxPathLength];
+    int _listenSocket;
+    int _connectionSocket;
+    // cancel() writes to the pipe for waking up poll()
+    int _cancelPipe[2];
+};
+
+#endif // USE_SOCKET_TRANSPORT_UC
+
+} // namespace update_client
@@ -0,0 +1,89 @@
+#include "uc_arena.hpp"
+
+namespace update_client {
+
+#if (MBED_CONF_UPDATE_CLIENT_ARENA_SIZE > 0)
+MBED_ALIGN(8) uint8_t UpdateClientArena::_storage[UpdateClientArena::kArenaSize];
+#endif
+size_t UpdateClientArena::_offset = 0;
+size_t UpdateClientArena::_peakSize = 0;
+
+UpdateClientArena::Session::Session()
+{
+    CriticalSectionLock lock;
+    _startOffset = _offset;
+}
+
+UpdateClientArena::Session::~Session()
+{
+    CriticalSectionLock lock;
+    _offset = _startOffset;
+}
+
+void *UpdateClientArena::allocate(size_t size, size_t alignment)
+{
+#if (MBED_CONF_UPDATE_CLIENT_ARENA_SIZE > 0)
+    CriticalSectionLock lock;
+
+    const size_t alignedOffset = (_offset + alignment - 1) & ~(alignment - 1);
+    if (alignedOffset + size > kArenaSize) {
+        MBED_ERROR1(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_OUT_OF_MEMORY),
+                    "Update client arena exhausted", size);
+    }
+    _offset = alignedOffset + size;
+    if (_offset > _peakSize) {
+        _peakSize = _offset;
+    }
+
+    return &_storage[alignedOffset];
+#else
+    (void) alignment;
+    void *pMemory = malloc(size);
+    if (pMemory == NULL) {
+        MBED_ERROR1(MBED_MAKE_ERROR(MBED_MODULE_APPLICATION, MBED_ERROR_CODE_OUT_OF_MEMORY),
+                    "Update client out of memory", size);
+    }
+
+    // released sizes are unknown, so the sizes reported in this case are upper bounds
+    CriticalSectionLock lock;
+    _offset += size;
+    if (_offset > _peakSize) {
+        _peakSize = _offset;
+    }
+
+    return pMemory;
+#endif
+}
+
+void UpdateClientArena::release(void *pMemory)
+{
+#if (MBED_CONF_UPDATE_CLIENT_ARENA_SIZE > 0)
+    // memory is given back when the session ends
+    (void) pMemory;
+#else
+    free(pMemory);
+#endif
+}
+
+size_t UpdateClientArena::getCapacity()
+{
+    return kArenaSize;
+}
+
+size_t UpdateClientArena::getUsedSize()
+{
+    return _offset;
+}
+
+size_t UpdateClientArena::getPeakSize()
+{
+    return _peakSize;
+}
+
+void UpdateClientArena::resetPeakSize()
+{
+    CriticalSectionLock lock;
+    _peakSize = _offset;
+}
+
+} // namespace update_client
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "mbed.h"
+
+namespace update_client {
+
+// UpdateClientArena supplies the buffers and objects used by the update client from a
+// static area sized with update-client.arena-size, so that an update session does not
+// depend on the heap. Memory is not released individually but when the session that
+// allocated it ends. If the arena size is 0, allocations are made on the heap
+
+class UpdateClientArena {
+public:
+    // memory allocated while a session exists is released when the session is destroyed
+    class Session {
+    public:
+        Session();
+        ~Session();
+
+    private:
+        // not copyable
+        Session(const Session &);
+        Session &operator=(const Session &);
+
+        size_t _startOffset;
+    };
+
+    // as operator new, raises an out of memory error if the arena is exhausted
+    static void *allocate(size_t size, size_t alignment = kDefaultAlignment);
+    static void release(void *pMemory);
+
+    static size_t getCapacity();
+    static size_t getUsedSize();
+    static size_t getPeakSize();
+    static void resetPeakSize();
+
+    static constexpr size_t kDefaultAlignment = 8;
+
+private:
+    static constexpr size_t kArenaSize = MBED_CONF_UPDATE_CLIENT_ARENA_SIZE;
+#if (MBED_CONF_UPDATE_CLIENT_ARENA_SIZE > 0)
+    static uint8_t _storage[kArenaSize];
+#endif
+    static size_t _offset;
+    static size_t _peakSize;
+};
+
+} // namespace update_client
@@ -0,0 +1,35 @@
+#include "uc_crc32.hpp"
+
+namespace update_client {
+
+uint32_t crc32(const uint8_t *pBuffer, uint32_t length)
+{
+    return crc32Finish(crc32Update(kCrc32Init, pBuffer, length));
+}
+
+uint32_t crc32Update(uint32_t crc, const uint8_t *pBuffer, uint32_t length)
+{
+    const uint8_t *pCurrent = pBuffer;
+
+    while (length--) {
+        crc ^= *pCurrent;
+        pCurrent++;
+
+        for (uint32_t counter = 0; counter < 8; counter++) {
+            if (crc & 1) {
+                crc = (crc >> 1) ^ 0xEDB88320;
+            } else {
+                crc = crc >> 1;
+            }
+        }
+    }
+
+    return crc;
+}
+
+uint32_t crc32Finish(uint32_t crc)
+{
+    return (crc ^ 0xFFFFFFFF);
+}
+
+} // namespace update_client
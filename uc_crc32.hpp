@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+namespace update_client {
+
+// CRC-32 (IEEE 802.3) as used in the application header
+uint32_t crc32(const uint8_t *pBuffer, uint32_t length);
+
+// incremental variant, to be started with kCrc32Init and completed with crc32Finish
+static constexpr uint32_t kCrc32Init = 0xFFFFFFFF;
+uint32_t crc32Update(uint32_t crc, const uint8_t *pBuffer, uint32_t length);
+uint32_t crc32Finish(uint32_t crc);
+
+} // namespace update_client
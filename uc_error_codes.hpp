@@ -10,7 +10,15 @@ enum UC_RETURN_CODES {
     UC_ERR_READING_FLASH = -3,
     UC_ERR_HASH_INVALID = -4,
     UC_ERR_FIRMWARE_EMPTY = -5,
-    UC_ERR_WRITE_FAILED = -6
+    UC_ERR_WRITE_FAILED = -6,
+    UC_ERR_INVALID_PARAMETER = -7,
+    UC_ERR_FIRMWARE_INCOMPLETE = -8,
+    UC_ERR_NOT_FOUND = -9,
+    UC_ERR_TIMEOUT = -10,
+    UC_ERR_DISCONNECTED = -11,
+    UC_ERR_CANCELLED = -12,
+    UC_ERR_INVALID_PATCH = -13,
+    UC_ERR_IMAGE_TOO_LARGE = -14
 };
 
 } // namespace update_client
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+namespace update_client {
+
+// Transport is the link over which a host sends updates to the downloader
+// Implementations exist for USBSerial, BufferedSerial and sockets (for host side tests)
+// All methods return UC_ERR_* codes. A cancelled transport returns UC_ERR_CANCELLED from
+// all waits until it is opened again, so that the downloader thread can be stopped at any time
+
+class Transport {
+public:
+    static constexpr uint32_t kWaitForever = 0xFFFFFFFF;
+
+    virtual ~Transport() {}
+
+    // make the transport available to the host
+    virtual int32_t open() = 0;
+    virtual void close() = 0;
+    // wait until a host is connected (UC_ERR_TIMEOUT if none connects in time)
+    virtual int32_t waitForConnection(uint32_t timeoutMs) = 0;
+    virtual bool isConnected() = 0;
+    // read what is available, up to size bytes, waiting up to timeoutMs for the first bytes
+    // returns UC_ERR_TIMEOUT or UC_ERR_DISCONNECTED when no data was read
+    virtual int32_t read(uint8_t *pBuffer, uint32_t size, uint32_t timeoutMs, uint32_t &nbrOfBytesRead) = 0;
+    // write all bytes
+    virtual int32_t write(const uint8_t *pBuffer, uint32_t size) = 0;
+    // wake up all waits with UC_ERR_CANCELLED, callable from any thread
+    virtual void cancel() = 0;
+};
+
+} // namespace update_client
@@ -0,0 +1,145 @@
+#include "usb_serial_transport.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "USBSerialTransport"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+#if (USE_USB_SERIAL_UC == 1)
+
+USBSerialWithEvents::USBSerialWithEvents(EventFlags &events, uint32_t connectedFlag,
+                                         uint32_t disconnectedFlag, uint32_t rxFlag) :
+    USBSerial(false),
+    _events(events),
+    _connectedFlag(connectedFlag),
+    _disconnectedFlag(disconnectedFlag),
+    _rxFlag(rxFlag)
+{
+
+}
+
+void USBSerialWithEvents::callback_state_change(DeviceState new_state)
+{
+    // the terminal is disconnected when the device is no longer configured
+    const bool wasConnected = connected();
+    USBSerial::callback_state_change(new_state);
+    signalConnection(wasConnected);
+}
+
+void USBSerialWithEvents::callback_request(const setup_packet_t *setup)
+{
+    // the terminal connection is set by a control line state request
+    const bool wasConnected = connected();
+    USBSerial::callback_request(setup);
+    signalConnection(wasConnected);
+}
+
+void USBSerialWithEvents::data_rx()
+{
+    USBSerial::data_rx();
+    _events.set(_rxFlag);
+}
+
+void USBSerialWithEvents::signalConnection(bool wasConnected)
+{
+    const bool isConnected = connected();
+    if (isConnected && ! wasConnected) {
+        _events.set(_connectedFlag);
+    } else if (! isConnected && wasConnected) {
+        _events.set(_disconnectedFlag);
+    }
+}
+
+USBSerialTransport::USBSerialTransport() :
+    _usbSerial(_events, CONNECTED_EVENT_FLAG, DISCONNECTED_EVENT_FLAG, RX_EVENT_FLAG)
+{
+
+}
+
+int32_t USBSerialTransport::open()
+{
+    _events.clear(CANCEL_EVENT_FLAG);
+    // the connection of the host is signaled by an event from then on
+    _usbSerial.connect();
+
+    return UC_ERR_NONE;
+}
+
+void USBSerialTransport::close()
+{
+    _usbSerial.disconnect();
+}
+
+int32_t USBSerialTransport::waitForConnection(uint32_t timeoutMs)
+{
+    if (! _usbSerial.connected()) {
+        const uint32_t flags = _events.wait_any(CONNECTED_EVENT_FLAG | CANCEL_EVENT_FLAG, timeoutMs, false);
+        if ((flags & osFlagsError) != 0) {
+            return UC_ERR_TIMEOUT;
+        }
+    }
+    if ((_events.get() & CANCEL_EVENT_FLAG) != 0) {
+        return UC_ERR_CANCELLED;
+    }
+    _events.clear(CONNECTED_EVENT_FLAG | DISCONNECTED_EVENT_FLAG | RX_EVENT_FLAG);
+    if (! _usbSerial.connected()) {
+        return UC_ERR_DISCONNECTED;
+    }
+
+    // flush the serial connection
+    _usbSerial.sync();
+    return UC_ERR_NONE;
+}
+
+bool USBSerialTransport::isConnected()
+{
+    return _usbSerial.connected();
+}
+
+int32_t USBSerialTransport::read(uint8_t *pBuffer, uint32_t size, uint32_t timeoutMs, uint32_t &nbrOfBytesRead)
+{
+    nbrOfBytesRead = 0;
+    while (true) {
+        // take what has been received, without blocking
+        _usbSerial.receive_nb(pBuffer, size, &nbrOfBytesRead);
+        if (nbrOfBytesRead > 0) {
+            return UC_ERR_NONE;
+        }
+        if (! _usbSerial.connected()) {
+            return UC_ERR_DISCONNECTED;
+        }
+
+        // wait for more data, the disconnection of the host or a cancellation
+        const uint32_t flags = _events.wait_any(RX_EVENT_FLAG | DISCONNECTED_EVENT_FLAG | CANCEL_EVENT_FLAG,
+                                                timeoutMs, false);
+        if ((flags & osFlagsError) != 0) {
+            return UC_ERR_TIMEOUT;
+        }
+        if ((flags & CANCEL_EVENT_FLAG) != 0) {
+            return UC_ERR_CANCELLED;
+        }
+        _events.clear(RX_EVENT_FLAG | DISCONNECTED_EVENT_FLAG);
+    }
+}
+
+int32_t USBSerialTransport::write(const uint8_t *pBuffer, uint32_t size)
+{
+    if (! _usbSerial.connected()) {
+        return UC_ERR_DISCONNECTED;
+    }
+    _usbSerial.send(const_cast<uint8_t *>(pBuffer), size);
+
+    return UC_ERR_NONE;
+}
+
+void USBSerialTransport::cancel()
+{
+    _events.set(CANCEL_EVENT_FLAG);
+}
+
+#endif // USE_USB_SERIAL_UC
+
+} // namespace update_client
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "mbed.h"
+#include "USBSerial.h"
+
+#include "uc_transport.hpp"
+
+namespace update_client {
+
+#if (USE_USB_SERIAL_UC == 1)
+
+// USBSerialWithEvents signals the connection and disconnection of the host terminal and
+// the reception of data with event flags, so that the transport never polls the connection
+// The callbacks are called from the USB interrupt context
+
+class USBSerialWithEvents :
+    public USBSerial {
+public:
+    USBSerialWithEvents(EventFlags &events, uint32_t connectedFlag, uint32_t disconnectedFlag, uint32_t rxFlag);
+
+protected:
+    virtual void callback_state_change(DeviceState new_state);
+    virtual void callback_request(const setup_packet_t *setup);
+    virtual void data_rx();
+
+private:
+    void signalConnection(bool wasConnected);
+
+    // data members
+    EventFlags &_events;
+    uint32_t _connectedFlag;
+    uint32_t _disconnectedFlag;
+    uint32_t _rxFlag;
+};
+
+// USBSerialTransport is a transport over the USB CDC device of the target
+
+class USBSerialTransport :
+    public Transport {
+public:
+    USBSerialTransport();
+
+    virtual int32_t open();
+    virtual void close();
+    virtual int32_t waitForConnection(uint32_t timeoutMs);
+    virtual bool isConnected();
+    virtual int32_t read(uint8_t *pBuffer, uint32_t size, uint32_t timeoutMs, uint32_t &nbrOfBytesRead);
+    virtual int32_t write(const uint8_t *pBuffer, uint32_t size);
+    virtual void cancel();
+
+private:
+    // data members
+    enum {
+        CANCEL_EVENT_FLAG = 1,
+        CONNECTED_EVENT_FLAG = 2,
+        DISCONNECTED_EVENT_FLAG = 4,
+        RX_EVENT_FLAG = 8
+    };
+    EventFlags _events;
+    USBSerialWithEvents _usbSerial;
+};
+
+#endif // USE_USB_SERIAL_UC
+
+} // namespace update_client
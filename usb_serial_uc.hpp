@@ -1,8 +1,9 @@
 #pragma once
 
 #include "mbed.h"
-#include "USBSerial.h"
-#include <chrono>
+
+#include "firmware_downloader.hpp"
+#include "usb_serial_transport.hpp"
 
 namespace update_client {
 
@@ -21,20 +22,11 @@ public:
     void stop();
 
 private:
-    // private method
-    void downloadFirmware();
-
     // data members
-    USBSerial _usbSerial;
-    Thread _downloaderThread;
-    enum {
-        STOP_EVENT_FLAG = 1
-    };
-    EventFlags _stopEvent;
-    static constexpr std::chrono::milliseconds kWaitTimeBetweenCheck = 5000ms;
+    USBSerialTransport _usbSerialTransport;
+    FirmwareDownloader _firmwareDownloader;
 };
 
 #endif // USE_USB_SERIAL_UC
 
 } // namespace
-
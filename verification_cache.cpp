@@ -0,0 +1,51 @@
+#include "verification_cache.hpp"
+#include "uc_error_codes.hpp"
+
+#include "mbed_trace.h"
+#if MBED_CONF_MBED_TRACE_ENABLE
+#define TRACE_GROUP "VerificationCache"
+#endif // MBED_CONF_MBED_TRACE_ENABLE
+
+namespace update_client {
+
+VerificationCache::VerificationCache(FlashRecordLog &recordLog) :
+    _recordLog(recordLog)
+{
+
+}
+
+bool VerificationCache::isVerified(uint32_t headerAddress, uint32_t headerCrc, uint64_t firmwareVersion)
+{
+    FlashRecordLog::Record record;
+    if (_recordLog.find(kVerifiedRecordType, headerAddress, record) != UC_ERR_NONE) {
+        return false;
+    }
+
+    return record.values[0] == headerCrc &&
+           record.values[1] == (uint32_t)(firmwareVersion >> 32) &&
+           record.values[2] == (uint32_t)(firmwareVersion & 0xFFFFFFFF);
+}
+
+int32_t VerificationCache::setVerified(uint32_t headerAddress, uint32_t headerCrc, uint64_t firmwareVersion)
+{
+    // do not wear the flash if the entry is already present
+    if (isVerified(headerAddress, headerCrc, firmwareVersion)) {
+        return UC_ERR_NONE;
+    }
+
+    tr_debug(" Caching verification of application at address 0x%08" PRIx32 "", headerAddress);
+    const uint32_t values[FlashRecordLog::kNbrOfValues] = {
+        headerCrc,
+        (uint32_t)(firmwareVersion >> 32),
+        (uint32_t)(firmwareVersion & 0xFFFFFFFF),
+        0
+    };
+    return _recordLog.write(kVerifiedRecordType, headerAddress, values);
+}
+
+int32_t VerificationCache::invalidate(uint32_t headerAddress)
+{
+    return _recordLog.remove(kVerifiedRecordType, headerAddress);
+}
+
+} // namespace update_client
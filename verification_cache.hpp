@@ -0,0 +1,29 @@
+#pragma once
+
+#include "flash_record_log.hpp"
+
+namespace update_client {
+
+// VerificationCache remembers which applications were successfully hashed, so that an
+// unchanged application does not need to be hashed again (at every boot for instance)
+// Entries are keyed on the header address of the application (that is on the slot) and
+// are only considered if the header CRC and the firmware version still match
+
+class VerificationCache {
+public:
+    // constructor
+    explicit VerificationCache(FlashRecordLog &recordLog);
+
+    bool isVerified(uint32_t headerAddress, uint32_t headerCrc, uint64_t firmwareVersion);
+    int32_t setVerified(uint32_t headerAddress, uint32_t headerCrc, uint64_t firmwareVersion);
+    // must be called before the application at the given address is rewritten
+    int32_t invalidate(uint32_t headerAddress);
+
+private:
+    // data members
+    FlashRecordLog &_recordLog;
+
+    static constexpr uint16_t kVerifiedRecordType = 1;
+};
+
+} // namespace update_client